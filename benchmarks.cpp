@@ -0,0 +1,682 @@
+#include "multicall.h"
+#include "multicall_dispatcher.h"
+#include "multicall_shm.h"
+#include "multicall_record.h"
+#include "multicall_trace.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <ctime>
+#if defined(__linux__)
+    #include <unistd.h>
+#endif
+
+using namespace multicall;
+
+using Payload8 = std::array<uint8_t, 8>;
+using Payload64 = std::array<uint8_t, 64>;
+using Payload512 = std::array<uint8_t, 512>;
+using Payload4096 = std::array<uint8_t, 4096>;
+
+class BenchInterface {
+public:
+    MC_DECLARE_INTERFACE(BenchInterface)
+
+    virtual ~BenchInterface() = default;
+
+    MC_DECLARE_SIGNAL(tick(int arg))
+    MC_DECLARE_SIGNAL(payload(Payload8 arg))
+    MC_DECLARE_SIGNAL(payload(Payload64 arg))
+    MC_DECLARE_SIGNAL(payload(Payload512 arg))
+    MC_DECLARE_SIGNAL(payload(Payload4096 arg))
+    MC_DECLARE_SIGNAL(stamp(int64_t ns))
+};
+
+class BenchSender : public BenchInterface, public MultiCallBase {
+public:
+    MC_DECLARE_SENDER()
+
+    void emitTick(int val) {
+        McEmit(McSignal<int>(this, &BenchInterface::tick), val);
+    }
+    template<class Payload>
+    void emitPayload(const Payload& payload) {
+        McEmit(McSignal<Payload>(this, &BenchInterface::payload), payload);
+    }
+    void emitStamp(int64_t ns) {
+        McEmit(McSignal<int64_t>(this, &BenchInterface::stamp), ns);
+    }
+    void emitTickParallel(McThreadPool& pool, int val) {
+        McEmitParallel(pool, McParallelMode::Wait, 0, McSignal<int>(this, &BenchInterface::tick), val);
+    }
+};
+
+class BenchReciever : public MultiCallBase {
+public:
+    int64_t calls = 0;
+    void tick(int) {
+        ++calls;
+    }
+    int key = 0;
+    void keyTick(int val) { //what a reciever interested in one key does without keyed connections
+        if (val == key) {
+            ++calls;
+        }
+    }
+    template<class Payload>
+    void payload(const Payload& payload) {
+        calls += payload[0];
+    }
+};
+
+int64_t global_calls = 0;
+void global_tick(int) {
+    ++global_calls;
+}
+
+using Clock = std::chrono::steady_clock;
+
+/// <summary>
+/// Collects the results and prints them as one JSON document: {"benchmarks": [{"name": ..., <params and metrics>}, ...]}
+/// </summary>
+class JsonReport {
+public:
+    class Record {
+    public:
+        Record& set(const std::string& key, double value) {
+            std::ostringstream stream;
+            stream << std::setprecision(10) << value;
+            m_fields.emplace_back(key, stream.str());
+            return *this;
+        }
+        Record& set(const std::string& key, const std::string& value) {
+            m_fields.emplace_back(key, "\"" + value + "\"");
+            return *this;
+        }
+
+    private:
+        friend JsonReport;
+        std::vector<std::pair<std::string, std::string>> m_fields;
+    };
+
+    Record& add(const std::string& name) {
+        m_records.emplace_back();
+        return m_records.back().set("name", name);
+    }
+
+    void write(std::ostream& out) const {
+        out << "{\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < m_records.size(); ++i) {
+            out << "    {";
+            const auto& fields = m_records[i].m_fields;
+            for (size_t j = 0; j < fields.size(); ++j) {
+                out << (j ? ", " : "") << "\"" << fields[j].first << "\": " << fields[j].second;
+            }
+            out << (i + 1 < m_records.size() ? "},\n" : "}\n");
+        }
+        out << "  ]\n}\n";
+    }
+
+private:
+    std::vector<Record> m_records;
+};
+
+JsonReport report;
+
+//Latency of single calls of f() in nanoseconds
+template<class F>
+void measureLatency(JsonReport::Record& record, size_t samples, F&& f) {
+    for (size_t i = 0; i < samples / 10; ++i) {
+        f(); //warm up
+    }
+    std::vector<double> latencies(samples);
+    for (size_t i = 0; i < samples; ++i) {
+        const auto start = Clock::now();
+        f();
+        latencies[i] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) { return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))]; };
+    record.set("samples", double(samples))
+        .set("p50_ns", percentile(0.5))
+        .set("p99_ns", percentile(0.99))
+        .set("p999_ns", percentile(0.999))
+        .set("max_ns", latencies.back());
+}
+
+//Calls of f() per second, f() is called in batches to hide the clock overhead
+template<class F>
+double measureThroughput(size_t iterations, F&& f) {
+    for (size_t i = 0; i < iterations / 10; ++i) {
+        f();
+    }
+    const auto start = Clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        f();
+    }
+    return iterations / std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void Bench_callback_kinds() {
+    {
+        BenchSender sender;
+        BenchReciever reciever;
+        MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+        measureLatency(report.add("emit_latency").set("callback", "member"), 1000000, [&]() { sender.emitTick(1); });
+        report.add("emit_throughput").set("callback", "member").set("emits_per_second", measureThroughput(10000000, [&]() { sender.emitTick(1); }));
+    }
+    {
+        BenchSender sender;
+        MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), global_tick);
+        measureLatency(report.add("emit_latency").set("callback", "free"), 1000000, [&]() { sender.emitTick(1); });
+        report.add("emit_throughput").set("callback", "free").set("emits_per_second", measureThroughput(10000000, [&]() { sender.emitTick(1); }));
+    }
+    {
+        BenchSender sender;
+        int64_t calls = 0;
+        MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), [&calls](int) { ++calls; });
+        measureLatency(report.add("emit_latency").set("callback", "lambda"), 1000000, [&]() { sender.emitTick(1); });
+        report.add("emit_throughput").set("callback", "lambda").set("emits_per_second", measureThroughput(10000000, [&]() { sender.emitTick(1); }));
+    }
+}
+
+void Bench_subscriber_count() {
+    static const size_t subscriber_counts[] = { 1, 10, 100, 1000, 10000 };
+    for (size_t subscribers : subscriber_counts) {
+        BenchSender sender;
+        std::vector<BenchReciever> recievers(subscribers);
+        for (BenchReciever& reciever : recievers) {
+            MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+        }
+        const size_t emits = std::max<size_t>(100, 10000000 / subscribers);
+        const double emits_per_second = measureThroughput(emits, [&]() { sender.emitTick(1); });
+        report.add("subscriber_count")
+            .set("subscribers", double(subscribers))
+            .set("emits_per_second", emits_per_second)
+            .set("calls_per_second", emits_per_second * subscribers);
+    }
+}
+
+//Every reciever is interested in one key: filtering in the callback versus keyed connections routed by the sender
+void Bench_keyed_routing() {
+    static const size_t subscriber_counts[] = { 10, 100, 1000, 10000 };
+    for (size_t subscribers : subscriber_counts) {
+        for (bool keyed : { false, true }) {
+            BenchSender sender;
+            std::vector<BenchReciever> recievers(subscribers);
+            for (size_t i = 0; i < subscribers; ++i) {
+                recievers[i].key = int(i);
+                if (keyed) {
+                    MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &recievers[i], &BenchReciever::tick, McKey(int(i)));
+                }else {
+                    MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &recievers[i], &BenchReciever::keyTick);
+                }
+            }
+            int key = 0;
+            const size_t emits = keyed ? 10000000 : std::max<size_t>(100, 10000000 / subscribers);
+            const double emits_per_second = measureThroughput(emits, [&]() {
+                sender.emitTick(key);
+                key = key + 1 == int(subscribers) ? 0 : key + 1;
+            });
+            report.add("keyed_routing")
+                .set("subscribers", double(subscribers))
+                .set("routing", keyed ? "keyed" : "callback")
+                .set("emits_per_second", emits_per_second);
+        }
+    }
+}
+
+template<class Payload>
+void Bench_argument_size() {
+    static const size_t subscribers = 10;
+    BenchSender sender;
+    std::vector<BenchReciever> recievers(subscribers);
+    for (BenchReciever& reciever : recievers) {
+        MultiCallBase::Connect(McSignal<Payload>(&sender, &BenchInterface::payload), &reciever, &BenchReciever::payload<Payload>);
+    }
+    Payload payload{};
+    payload[0] = 1;
+    auto& record = report.add("argument_size").set("bytes", double(sizeof(Payload))).set("subscribers", double(subscribers));
+    record.set("emits_per_second", measureThroughput(1000000, [&]() { sender.emitPayload(payload); }));
+    measureLatency(record, 100000, [&]() { sender.emitPayload(payload); });
+}
+
+//Emit latency while another thread connects and disconnects all the time, to the same signal or to another signal of the sender
+void Bench_churn(bool same_signal) {
+    static const size_t subscribers = 10;
+    BenchSender sender;
+    std::vector<BenchReciever> recievers(subscribers);
+    for (BenchReciever& reciever : recievers) {
+        MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+    }
+    std::atomic<bool> stop{ false };
+    std::atomic<int64_t> churn_operations{ 0 };
+    std::thread churner([&]() {
+        BenchReciever reciever;
+        while (!stop) {
+            if (same_signal) {
+                MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+                MultiCallBase::Disconnect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+            }else {
+                MultiCallBase::Connect(McSignal<Payload8>(&sender, &BenchInterface::payload), &reciever, &BenchReciever::payload<Payload8>);
+                MultiCallBase::Disconnect(McSignal<Payload8>(&sender, &BenchInterface::payload), &reciever, &BenchReciever::payload<Payload8>);
+            }
+            churn_operations += 2;
+        }
+    });
+    auto& record = report.add("emit_under_churn").set("subscribers", double(subscribers)).set("churned_signal", same_signal ? "same" : "other");
+    const auto start = Clock::now();
+    measureLatency(record, 1000000, [&]() { sender.emitTick(1); });
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stop = true;
+    churner.join();
+    record.set("churn_operations_per_second", churn_operations / seconds);
+}
+
+//Disconnection by McConnection handle, and the teardown of objects with many connections
+void Bench_teardown() {
+    static const size_t connection_counts[] = { 100, 1000, 10000 };
+    for (size_t connections : connection_counts) {
+        std::vector<BenchSender> senders(connections);
+        auto& record = report.add("teardown").set("connections", double(connections));
+        {
+            BenchReciever reciever;
+            std::vector<McConnection> handles;
+            handles.reserve(connections);
+            for (BenchSender& sender : senders) {
+                handles.push_back(MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick));
+            }
+            const auto start = Clock::now();
+            for (McConnection& handle : handles) {
+                handle.disconnect();
+            }
+            record.set("handle_disconnect_ns", std::chrono::duration<double, std::nano>(Clock::now() - start).count() / connections);
+        }
+        {
+            auto reciever = std::make_unique<BenchReciever>();
+            for (BenchSender& sender : senders) {
+                MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), reciever.get(), &BenchReciever::tick);
+            }
+            const auto start = Clock::now();
+            reciever.reset();
+            record.set("reciever_teardown_ns", std::chrono::duration<double, std::nano>(Clock::now() - start).count() / connections);
+        }
+        {
+            auto sender = std::make_unique<BenchSender>();
+            std::vector<BenchReciever> recievers(connections);
+            for (BenchReciever& reciever : recievers) {
+                MultiCallBase::Connect(McSignal<int>(sender.get(), &BenchInterface::tick), &reciever, &BenchReciever::tick);
+            }
+            const auto start = Clock::now();
+            sender.reset();
+            record.set("sender_teardown_ns", std::chrono::duration<double, std::nano>(Clock::now() - start).count() / connections);
+        }
+    }
+}
+
+//The lookups of the connection bookkeeping: hashing and comparing McFunctionId, and a Connect()/Disconnect() pair by the method
+void Bench_function_id() {
+    BenchReciever reciever, other_reciever;
+    const McFunctionId id(ArgsPlaceholder<int>{}, &reciever, &BenchReciever::tick);
+    const McFunctionId same(&reciever, &BenchReciever::tick);
+    const McFunctionId other(&other_reciever, &BenchReciever::tick);
+    volatile size_t sink = 0;
+    auto& record = report.add("function_id");
+    record.set("hashes_per_second", measureThroughput(10000000, [&]() { sink = sink + id.hash(); }));
+    record.set("equal_compares_per_second", measureThroughput(10000000, [&]() { sink = sink + (id == same); }));
+    record.set("unequal_compares_per_second", measureThroughput(10000000, [&]() { sink = sink + (id == other); }));
+    record.set("get_object_per_second", measureThroughput(10000000, [&]() { sink = sink + size_t(id.getObject()); }));
+
+    BenchSender sender;
+    std::vector<BenchReciever> recievers(100);
+    for (BenchReciever& connected : recievers) {
+        MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &connected, &BenchReciever::tick);
+    }
+    record.set("connect_disconnect_per_second", measureThroughput(100000, [&]() {
+        MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+        MultiCallBase::Disconnect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+    }));
+}
+
+//Emits to 10 subscribers with the trace points of MC_ENABLE_TRACING (if compiled in) disabled and enabled
+void Bench_tracing() {
+    static const size_t subscribers = 10;
+    BenchSender sender;
+    std::vector<BenchReciever> recievers(subscribers);
+    for (BenchReciever& reciever : recievers) {
+        MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+    }
+    auto& record = report.add("tracing").set("subscribers", double(subscribers)).set("compiled", double(MC_ENABLE_TRACING));
+    record.set("disabled_emits_per_second", measureThroughput(1000000, [&]() { sender.emitTick(1); }));
+#if MC_ENABLE_TRACING
+    static const size_t emits = 100000;
+    McTracer::clear();
+    McTracer::enable(emits * (subscribers + 1) * 2 * 2); //the warm up of measureThroughput() is traced too
+    record.set("enabled_emits_per_second", measureThroughput(emits, [&]() { sender.emitTick(1); }));
+    McTracer::disable();
+    const std::vector<McTraceThread> threads = McTracer::collect();
+    std::ostringstream out;
+    const auto start = Clock::now();
+    McWriteChromeTrace(out, threads);
+    record.set("chrome_export_ns_per_event", std::chrono::duration<double, std::nano>(Clock::now() - start).count() / threads[0].events.size());
+    record.set("dropped", double(threads[0].dropped));
+    McTracer::clear();
+#endif
+}
+
+//Resident memory of the process, 0 where it isn't known
+size_t residentBytes() {
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0, resident_pages = 0;
+    statm >> total_pages >> resident_pages;
+    return resident_pages * size_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+//1M recievers of which 1% are connected: memory per object, and the cost of creating and destroying objects that are mostly idle
+void Bench_idle_objects() {
+    static const size_t objects = 1000000;
+    static const size_t connected_every = 100;
+    BenchSender sender;
+    auto& record = report.add("idle_objects").set("objects", double(objects)).set("connected", double(objects / connected_every));
+    record.set("sizeof_multicallbase", double(sizeof(MultiCallBase))).set("sizeof_reciever", double(sizeof(BenchReciever)));
+    const size_t resident_before = residentBytes();
+    auto start = Clock::now();
+    auto recievers = std::make_unique<BenchReciever[]>(objects);
+    record.set("construct_ns", std::chrono::duration<double, std::nano>(Clock::now() - start).count() / objects);
+    for (size_t i = 0; i < objects; i += connected_every) {
+        MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &recievers[i], &BenchReciever::tick);
+    }
+    record.set("resident_bytes_per_object", double(residentBytes() - resident_before) / objects);
+    BenchSender idle_sender;
+    record.set("idle_emits_per_second", measureThroughput(10000000, [&]() { idle_sender.emitTick(1); }));
+    sender.DisconnectFromAll();
+    start = Clock::now();
+    recievers.reset();
+    record.set("destroy_ns", std::chrono::duration<double, std::nano>(Clock::now() - start).count() / objects);
+}
+
+#if defined(__linux__)
+//Queued events delivered to an epoll loop thread by McDispatcher: throughput and the number of eventfd wakeups per event
+void Bench_dispatcher() {
+    static const int events = 1000000;
+    BenchSender sender;
+    McDispatcher dispatcher;
+    std::atomic<bool> bound{ false };
+    std::atomic<int64_t> wakeups{ 0 };
+    std::thread loop([&]() {
+        BenchReciever reciever;
+        dispatcher.bind(reciever, 4096, McOverflowPolicy::Block);
+        MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick, McConnectionType::Queued);
+        const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        dispatcher.addTo(epoll_fd);
+        bound = true;
+        while (reciever.calls < events) {
+            epoll_event event{};
+            if (epoll_wait(epoll_fd, &event, 1, 100) == 1) {
+                ++wakeups;
+                dispatcher.dispatch();
+            }
+        }
+        close(epoll_fd);
+    });
+    while (!bound) {
+        std::this_thread::yield();
+    }
+    const auto start = Clock::now();
+    for (int i = 0; i < events; ++i) {
+        sender.emitTick(i);
+    }
+    loop.join();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    report.add("dispatcher").set("events", double(events))
+        .set("events_per_second", events / seconds)
+        .set("wakeups_per_event", double(wakeups) / events);
+}
+#endif
+
+#if defined(__unix__)
+//A signal mirrored into shared memory and re-emitted by a proxy that maps the ring on its own (as another process would) on another thread.
+//Throughput of the whole path against McEmit() in the process, and the one-way latency when the consumer keeps up.
+void Bench_shm_transport() {
+    static const int64_t records = 5000000;
+    static const int64_t latency_samples = 20000;
+    const std::string name = "/multicall_bench_" + std::to_string(getpid());
+    {
+        BenchSender in_process;
+        BenchReciever reciever;
+        MultiCallBase::Connect(McSignal<int>(&in_process, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+        const double in_process_emits_per_second = measureThroughput(10000000, [&]() { in_process.emitTick(1); });
+
+        BenchSender sender;
+        McShmPublisher<int> publisher(McSignal<int>(&sender, &BenchInterface::tick), name, 65536);
+        McShmProxy<BenchInterface, int> proxy(name, &BenchInterface::tick);
+        BenchReciever remote_reciever;
+        MultiCallBase::Connect(proxy.signal(), &remote_reciever, &BenchReciever::tick);
+        std::atomic<bool> done{ false };
+        std::thread consumer([&]() {
+            while (!done || proxy.poll() != 0) {
+                if (proxy.poll() == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        const auto start = Clock::now();
+        for (int64_t i = 0; i < records; ++i) {
+            sender.emitTick(1);
+        }
+        const double producer_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        done = true;
+        consumer.join();
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        report.add("shm_transport")
+            .set("ring_capacity", 65536.0)
+            .set("published_per_second", records / producer_seconds)
+            .set("delivered_per_second", remote_reciever.calls / seconds)
+            .set("overruns", double(proxy.overruns()))
+            .set("in_process_emits_per_second", in_process_emits_per_second);
+    }
+    {
+        BenchSender sender;
+        McShmPublisher<int64_t> publisher(McSignal<int64_t>(&sender, &BenchInterface::stamp), name, 1024);
+        McShmProxy<BenchInterface, int64_t> proxy(name, &BenchInterface::stamp);
+        std::vector<double> latencies;
+        latencies.reserve(latency_samples);
+        std::atomic<int64_t> received{ 0 };
+        MultiCallBase::Connect(proxy.signal(), [&latencies, &received](int64_t ns) {
+            latencies.push_back(double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count() - ns));
+            received.store(received.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        });
+        std::thread consumer([&]() {
+            while (received.load(std::memory_order_acquire) < latency_samples) {
+                if (proxy.poll() == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        for (int64_t i = 0; i < latency_samples; ++i) {
+            sender.emitStamp(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+            while (received.load(std::memory_order_acquire) <= i) {
+                std::this_thread::yield();
+            }
+        }
+        consumer.join();
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p) { return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))]; };
+        report.add("shm_transport_latency")
+            .set("samples", double(latencies.size()))
+            .set("p50_ns", percentile(0.5))
+            .set("p99_ns", percentile(0.99))
+            .set("p999_ns", percentile(0.999))
+            .set("max_ns", latencies.back());
+    }
+}
+
+//Emits with a McRecorder attached against the same emits without it, and the replay of the log at full speed
+void Bench_record_replay() {
+    static const size_t emits = 5000000;
+    const std::string path = "/tmp/multicall_bench_" + std::to_string(getpid()) + ".mclog";
+    BenchSender sender;
+    BenchReciever reciever;
+    MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), &reciever, &BenchReciever::tick);
+    const double plain_emits_per_second = measureThroughput(emits, [&]() { sender.emitTick(1); });
+    auto& record = report.add("record_replay").set("emits", double(emits)).set("plain_emits_per_second", plain_emits_per_second);
+    {
+        McRecorder<int> recorder(McSignal<int>(&sender, &BenchInterface::tick), path, 4 << 20);
+        int value = 0;
+        const auto start = Clock::now();
+        for (size_t i = 0; i < emits; ++i) {
+            sender.emitTick(value++);
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        recorder.close();
+        record.set("recorded_emits_per_second", emits / seconds)
+            .set("dropped_ratio", double(recorder.dropped()) / emits);
+    }
+    McReplayer<BenchInterface, int> replayer(path, &BenchInterface::tick);
+    BenchReciever replay_reciever;
+    MultiCallBase::Connect(replayer.signal(), &replay_reciever, &BenchReciever::tick);
+    const auto start = Clock::now();
+    const size_t replayed = replayer.replay(McReplayTiming::FullSpeed);
+    record.set("replayed_emits_per_second", replayed / std::chrono::duration<double>(Clock::now() - start).count());
+    unlink(path.c_str());
+}
+#endif
+
+void Bench_parallel_emit() {
+    static const size_t subscriber_counts[] = { 10, 1000, 10000 };
+    const size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t subscribers : subscriber_counts) {
+        BenchSender sender;
+        std::atomic<int64_t> work_result{ 0 };
+        for (size_t i = 0; i < subscribers; ++i) {
+            MultiCallBase::Connect(McSignal<int>(&sender, &BenchInterface::tick), [&work_result, i](int val) {
+                int64_t result = val;
+                for (int j = 0; j < 200; ++j) { //some non-trivial work per call
+                    result = result * 6364136223846793005LL + int64_t(i);
+                }
+                if (result == 42) {
+                    ++work_result;
+                }
+            });
+        }
+        for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+            McThreadPool pool(threads);
+            const size_t emits = std::max<size_t>(10, 2000000 / (subscribers * 200));
+            int val = 0;
+            const double emits_per_second = measureThroughput(emits, [&]() {
+                sender.emitTickParallel(pool, ++val);
+            });
+            report.add("parallel_emit")
+                .set("subscribers", double(subscribers))
+                .set("threads", double(threads))
+                .set("us_per_emit", 1e6 / emits_per_second);
+        }
+    }
+}
+
+//Readers (emitters) take the lock all the time, one writer (connections) takes it every 20 us.
+//cpu_seconds against wall_seconds shows how much CPU the waiting threads burn.
+template<class Mutex>
+void Bench_lock_contention(const std::string& name) {
+    static const auto duration = std::chrono::milliseconds(300);
+    const size_t max_readers = std::max(2u, std::thread::hardware_concurrency());
+    for (size_t readers = 1; readers <= max_readers; readers *= 2) {
+        Mutex mutex;
+        std::atomic<bool> stop{ false };
+        std::atomic<uint64_t> reads{ 0 };
+        int64_t shared_value = 0;
+        std::vector<double> write_latencies;
+        std::vector<std::thread> threads;
+        const std::clock_t cpu_start = std::clock();
+        const auto start = Clock::now();
+        for (size_t i = 0; i < readers; ++i) {
+            threads.emplace_back([&]() {
+                uint64_t local_reads = 0;
+                int64_t sum = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    mutex.lock_shared();
+                    sum += shared_value;
+                    mutex.unlock_shared();
+                    ++local_reads;
+                }
+                reads += local_reads + (sum == 42 ? 1 : 0);
+            });
+        }
+        threads.emplace_back([&]() {
+            while (!stop.load(std::memory_order_relaxed)) {
+                const auto lock_start = Clock::now();
+                mutex.lock();
+                write_latencies.push_back(std::chrono::duration<double, std::nano>(Clock::now() - lock_start).count());
+                ++shared_value;
+                mutex.unlock();
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        });
+        std::this_thread::sleep_for(duration);
+        stop = true;
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        const double wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        const double cpu_seconds = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+        std::sort(write_latencies.begin(), write_latencies.end());
+        auto percentile = [&write_latencies](double p) {
+            return write_latencies.empty() ? 0.0 : write_latencies[std::min(write_latencies.size() - 1, size_t(p * write_latencies.size()))];
+        };
+        report.add("lock_contention")
+            .set("lock", name)
+            .set("readers", double(readers))
+            .set("reads_per_second", reads / wall_seconds)
+            .set("writes_per_second", write_latencies.size() / wall_seconds)
+            .set("write_lock_p50_ns", percentile(0.5))
+            .set("write_lock_p99_ns", percentile(0.99))
+            .set("write_lock_p999_ns", percentile(0.999))
+            .set("wall_seconds", wall_seconds)
+            .set("cpu_seconds", cpu_seconds);
+    }
+}
+
+int main(int argc, char** argv) {
+    Bench_callback_kinds();
+    Bench_subscriber_count();
+    Bench_keyed_routing();
+    Bench_argument_size<Payload8>();
+    Bench_argument_size<Payload64>();
+    Bench_argument_size<Payload512>();
+    Bench_argument_size<Payload4096>();
+    Bench_churn(true);
+    Bench_churn(false);
+    Bench_teardown();
+    Bench_function_id();
+    Bench_idle_objects();
+    Bench_tracing();
+#if defined(__linux__)
+    Bench_dispatcher();
+#endif
+#if defined(__unix__)
+    Bench_shm_transport();
+    Bench_record_replay();
+#endif
+    Bench_parallel_emit();
+    Bench_lock_contention<McAdaptiveSharedMutex>("McAdaptiveSharedMutex");
+    Bench_lock_contention<McStdSharedMutex>("McStdSharedMutex");
+
+    if (argc > 1) {
+        std::ofstream out(argv[1]);
+        report.write(out);
+    }else {
+        report.write(std::cout);
+    }
+    return 0;
+}
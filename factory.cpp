@@ -1,4 +1,5 @@
 #include "factory.h"
+#include <thread>
 
 namespace 
 {
@@ -6,6 +7,8 @@ namespace
 
 	class SenderType1 : public SenderInterface, public MultiCallBase {
 	public:
+		MC_DECLARE_SENDER()
+
 		SenderType1(bool call_tick2 = false) : call_tick2_(call_tick2) {
 			m_thread = std::thread(&SenderType1::senderThread, this);
 		}
@@ -33,6 +36,8 @@ namespace
 
 	class SenderType2 : public SenderInterface, public MultiCallBase {
 	public:
+		MC_DECLARE_SENDER()
+
 		SenderType2() {
 			m_thread = std::thread(&SenderType2::senderThread, this);
 			m_thread2 = std::thread(&SenderType2::senderThread2, this);
@@ -9,7 +9,9 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <functional>
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include <map>
@@ -17,198 +19,1001 @@
 #include <shared_mutex>
 #include <atomic>
 #include <tuple>
+#include <utility>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <deque>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <string>
 #include <string.h>
+#include <stdio.h>
+#include <climits>
 
-#define MC_DECLARE_INTERFACE(interfaceType) using __MC_IINTERFACE = interfaceType;
-#define MC_DECLARE_SIGNAL(signal_name) virtual void signal_name final {};
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#include <immintrin.h>
+#endif
+#if defined(__linux__)
+	#include <linux/futex.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+#if !defined(MC_HAS_RTTI)
+	#if defined(__cpp_rtti) || defined(__GXX_RTTI) || defined(_CPPRTTI)
+		#define MC_HAS_RTTI 1
+	#else
+		#define MC_HAS_RTTI 0
+	#endif
+#endif
+
+//Inline storage of a callback in McFunctionId (with its vtbl pointer). Bigger callbacks are allocated by MC_ALLOCATOR.
+#if !defined(MC_INLINE_CALLABLE_SIZE)
+	#define MC_INLINE_CALLABLE_SIZE (sizeof(size_t) * 6) // 6 is emperic. Just enough to put pointers to an object and a method with vtbl here
+#endif
+//1 - a callback that doesn't fit MC_INLINE_CALLABLE_SIZE doesn't compile instead of being allocated
+#if !defined(MC_INLINE_CALLABLES_ONLY)
+	#define MC_INLINE_CALLABLES_ONLY 0
+#endif
+
+//Must be the first MC_ macro of an interface: the signals are numbered from here.
+//__COUNTER__ differs from one translation unit to another, so the base is an enumerator rather than a static member: it is no object the
+//translation units could disagree on, only the differences from it (the same everywhere) reach the types of the signals.
+#define MC_DECLARE_INTERFACE(interfaceType) using __MC_IINTERFACE = interfaceType; \
+	enum : size_t { __mc_signals_base = __COUNTER__ }; \
+	virtual ::multicall::MultiCallBase* __mcMultiCallBase() noexcept { return ::multicall::__mcInterfaceToMultiCallBase(this); }
+//The return type carries a dense compile-time index of the signal within its interface (overloads get different indexes)
+#define MC_DECLARE_SIGNAL(signal_name) virtual ::multicall::McSignalSlot<__COUNTER__ - __mc_signals_base - 1> signal_name final { return {}; };
+//Put it into a class that implements an interface and inherits MultiCallBase. 
+//It lets to find the sender without dynamic_cast, so it is required for senders if RTTI is disabled.
+#define MC_DECLARE_SENDER() ::multicall::MultiCallBase* __mcMultiCallBase() noexcept override { return this; }
+
+//The locks of MultiCallBase (one per connected signal and two per object): a shared mutex with a McLockMetrics metrics member. McAdaptiveSharedMutex or McStdSharedMutex.
+#if !defined(MC_SHARED_MUTEX)
+	#define MC_SHARED_MUTEX ::multicall::McAdaptiveSharedMutex
+#endif
+
+//1 - count emits, measure the calls of every subscriber and the lock waits (see MultiCallBase::ConnectionGraph()).
+//0 - nothing of it is compiled, the graph is still available with zero statistics.
+#if !defined(MC_ENABLE_METRICS)
+	#define MC_ENABLE_METRICS 0
+#endif
 
-//Just for test. Don't use it.
-#define MC_CONFIG_USE_SPINLOCK 0
+//1 - McEmit() and the subscriber calls record trace events while McTracer is enabled (see multicall_trace.h for the export).
+//While it is disabled every trace point costs one branch. 0 - nothing of it is compiled, McTracer never records.
+#if !defined(MC_ENABLE_TRACING)
+	#define MC_ENABLE_TRACING 0
+#endif
 
 namespace multicall 
 {
+	/// <summary>
+	/// Runtime statistics collected if MC_ENABLE_METRICS is 1. Times are in nanoseconds.
+	/// </summary>
+	struct McLockStats {
+		uint64_t contentions = 0; //locks that had to wait
+		uint64_t wait_ns = 0;
+	};
+
+	struct McDispatchStats {
+		uint64_t calls = 0;
+		uint64_t total_ns = 0;
+		uint64_t max_ns = 0;
+	};
+
+	struct McLockMetrics {
+		std::atomic<uint64_t> contentions{ 0 };
+		std::atomic<uint64_t> wait_ns{ 0 };
+
+		inline void record(std::chrono::steady_clock::time_point start) noexcept {
+			contentions.fetch_add(1, std::memory_order_relaxed);
+			wait_ns.fetch_add(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()), std::memory_order_relaxed);
+		}
+		inline McLockStats stats() const noexcept { return McLockStats{ contentions.load(std::memory_order_relaxed), wait_ns.load(std::memory_order_relaxed) }; }
+	};
+
+	struct McDispatchMetrics {
+		std::atomic<uint64_t> calls{ 0 };
+		std::atomic<uint64_t> total_ns{ 0 };
+		std::atomic<uint64_t> max_ns{ 0 };
+
+		inline void record(std::chrono::steady_clock::duration duration) noexcept {
+			const uint64_t ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+			calls.fetch_add(1, std::memory_order_relaxed);
+			total_ns.fetch_add(ns, std::memory_order_relaxed);
+			uint64_t max = max_ns.load(std::memory_order_relaxed);
+			while (ns > max && !max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+		}
+		inline McDispatchStats stats() const noexcept {
+			return McDispatchStats{ calls.load(std::memory_order_relaxed), total_ns.load(std::memory_order_relaxed), max_ns.load(std::memory_order_relaxed) };
+		}
+	};
+
+	struct McSignalMetrics {
+		std::atomic<uint64_t> emits{ 0 };
+	};
+
+	/// <summary>
+	/// The begin or the end of an emit or of a subscriber call, recorded by McTracer. The time is of steady_clock, in nanoseconds.
+	/// </summary>
+	struct McTraceEvent {
+		enum class Kind : uint8_t {
+			EmitBegin,
+			EmitEnd,
+			CallBegin,
+			CallEnd
+		};
+
+		uint64_t timestamp_ns = 0;
+		Kind kind = Kind::EmitBegin;
+		uint32_t index = 0; //of the signal within its interface
+		const void* sender = nullptr;
+		const char* interface_tag = nullptr; //&McInterfaceTag<Interface>::id
+		const void* reciever = nullptr; //MultiCallBase of the subscriber, nullptr for emits and for callbacks without an object
+		const void* callable = nullptr; //the callback of the subscriber, tells apart the subscribers without an object
+
+		inline bool isBegin() const noexcept { return kind == Kind::EmitBegin || kind == Kind::CallBegin; }
+	};
+
+	/// <summary>
+	/// The events of one thread. Only that thread writes, an event is published by the release of the size,
+	/// so the recorded part is read without locks. A begin is dropped if there's no room for its end, so slices are never cut.
+	/// </summary>
+	class McTraceBuffer {
+	public:
+		McTraceBuffer(uint32_t thread_index, size_t capacity) : m_thread_index(thread_index), m_events(std::max<size_t>(capacity, 2)) {}
+
+		inline bool begin(const McTraceEvent& event) noexcept {
+			const size_t size = m_size.load(std::memory_order_relaxed);
+			if (size + m_open + 2 > m_events.size()) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			++m_open;
+			publish(size, event);
+			return true;
+		}
+		//Only for a begin that was recorded, its room is reserved
+		inline void end(const McTraceEvent& event) noexcept {
+			--m_open;
+			publish(m_size.load(std::memory_order_relaxed), event);
+		}
+
+		inline uint32_t threadIndex() const noexcept { return m_thread_index; }
+		inline size_t size() const noexcept { return m_size.load(std::memory_order_acquire); }
+		inline const McTraceEvent& operator [] (size_t index) const noexcept { return m_events[index]; }
+		inline uint64_t dropped() const noexcept { return m_dropped.load(std::memory_order_relaxed); }
+
+		std::string thread_name; //guarded by the lock of McTracer, see McTracer::nameThread()
+
+	private:
+		inline void publish(size_t size, const McTraceEvent& event) noexcept {
+			m_events[size] = event;
+			m_size.store(size + 1, std::memory_order_release);
+		}
+
+		const uint32_t m_thread_index;
+		std::vector<McTraceEvent> m_events;
+		std::atomic<size_t> m_size{ 0 };
+		size_t m_open = 0; //begins without an end yet
+		std::atomic<uint64_t> m_dropped{ 0 };
+	};
+
+	/// <summary>
+	/// The recorded events of one thread, see McTracer::collect()
+	/// </summary>
+	struct McTraceThread {
+		uint32_t index = 0; //1, 2... in the order the threads recorded their first event
+		std::string name;
+		std::vector<McTraceEvent> events; //in the order of recording, begins and ends are nested
+		uint64_t dropped = 0;
+	};
+
+	/// <summary>
+	/// Switches the trace points of MC_ENABLE_TRACING on and off at runtime. Every thread records into a buffer of its own,
+	/// a thread takes the lock only to register its buffer at its first event after enable() or clear().
+	/// </summary>
+	class McTracer {
+	public:
+		static inline bool enabled() noexcept { return MC_ENABLE_TRACING && s_enabled.load(std::memory_order_relaxed); }
+
+		//events_per_thread applies to the buffers registered after the call
+		static inline void enable(size_t events_per_thread = size_t(1) << 20) noexcept {
+			s_capacity.store(events_per_thread, std::memory_order_relaxed);
+			s_enabled.store(MC_ENABLE_TRACING != 0, std::memory_order_relaxed);
+		}
+		static inline void disable() noexcept { s_enabled.store(false, std::memory_order_relaxed); }
+
+		//Forgets the recorded events. The emits that are still running finish their slices in the forgotten buffers,
+		//every McTraceSlice keeps its buffer alive.
+		static inline void clear() {
+			std::lock_guard locker(s_mutex);
+			s_buffers.clear();
+			s_generation.fetch_add(1, std::memory_order_release);
+		}
+
+		//Names the calling thread in the exported traces
+		static inline void nameThread(std::string name) {
+			ThreadLocal& local = threadLocal();
+			std::lock_guard locker(s_mutex);
+			local.name = std::move(name);
+			if (local.buffer) {
+				local.buffer->thread_name = local.name;
+			}
+		}
+
+		//Copies the events recorded so far, the threads keep recording meanwhile
+		static inline std::vector<McTraceThread> collect() {
+			std::lock_guard locker(s_mutex);
+			std::vector<McTraceThread> threads;
+			threads.reserve(s_buffers.size());
+			for (const auto& buffer : s_buffers) {
+				McTraceThread& thread = threads.emplace_back();
+				thread.index = buffer->threadIndex();
+				thread.name = buffer->thread_name;
+				const size_t size = buffer->size();
+				thread.events.reserve(size);
+				for (size_t i = 0; i < size; ++i) {
+					thread.events.push_back((*buffer)[i]);
+				}
+				thread.dropped = buffer->dropped();
+			}
+			return threads;
+		}
+
+		//The buffer of the calling thread, registered on first use. Valid until the next call on this thread, copy it to keep it longer.
+		static inline const std::shared_ptr<McTraceBuffer>& threadBuffer() {
+			ThreadLocal& local = threadLocal();
+			const uint64_t generation = s_generation.load(std::memory_order_acquire);
+			if (!local.buffer || local.generation != generation) {
+				std::lock_guard locker(s_mutex);
+				local.buffer = std::make_shared<McTraceBuffer>(++s_thread_count, s_capacity.load(std::memory_order_relaxed));
+				local.buffer->thread_name = local.name;
+				local.generation = generation;
+				s_buffers.push_back(local.buffer);
+			}
+			return local.buffer;
+		}
+
+		static inline uint64_t now() noexcept {
+			return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+	private:
+		struct ThreadLocal {
+			std::shared_ptr<McTraceBuffer> buffer; //shared with s_buffers, so the events outlive the thread
+			uint64_t generation = 0;
+			std::string name;
+		};
+		static inline ThreadLocal& threadLocal() {
+			static thread_local ThreadLocal local;
+			return local;
+		}
+
+		static inline std::atomic<bool> s_enabled{ false };
+		static inline std::atomic<size_t> s_capacity{ size_t(1) << 20 };
+		static inline std::atomic<uint64_t> s_generation{ 0 };
+		static inline std::mutex s_mutex; //guards s_buffers and s_thread_count
+		static inline std::vector<std::shared_ptr<McTraceBuffer>> s_buffers;
+		static inline uint32_t s_thread_count = 0;
+	};
+
+	/// <summary>
+	/// Records a begin at construction and its end at destruction, if McTracer is enabled at construction
+	/// </summary>
+	class McTraceSlice {
+	public:
+		inline McTraceSlice(McTraceEvent::Kind begin, const void* sender, const char* interface_tag, size_t index, const void* reciever = nullptr, const void* callable = nullptr) {
+			if (McTracer::enabled()) {
+				m_event = McTraceEvent{ McTracer::now(), begin, uint32_t(index), sender, interface_tag, reciever, callable };
+				const std::shared_ptr<McTraceBuffer>& buffer = McTracer::threadBuffer();
+				if (buffer->begin(m_event)) {
+					m_buffer = buffer; //clear() may replace the buffer of the thread before the end
+				}
+			}
+		}
+		McTraceSlice(const McTraceSlice&) = delete;
+		McTraceSlice& operator = (const McTraceSlice&) = delete;
+		inline ~McTraceSlice() {
+			if (m_buffer) {
+				m_event.timestamp_ns = McTracer::now();
+				m_event.kind = m_event.kind == McTraceEvent::Kind::EmitBegin ? McTraceEvent::Kind::EmitEnd : McTraceEvent::Kind::CallEnd;
+				m_buffer->end(m_event);
+			}
+		}
+
+	private:
+		std::shared_ptr<McTraceBuffer> m_buffer;
+		McTraceEvent m_event;
+	};
+
+	//Tells the CPU that the thread is spinning, so the other hyper-thread runs faster and the spin takes less power
+	inline void mcCpuRelax() noexcept {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+		_mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+		asm volatile("yield");
+#endif
+	}
+
+	//Sleeps while word == expected (or until a wake). Without futexes it just sleeps a bit, the caller checks the word again anyway.
+	inline void mcFutexWait(std::atomic<uint32_t>& word, uint32_t expected) noexcept {
+#if defined(__linux__)
+		static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+		if (word.load(std::memory_order_relaxed) == expected) {
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+#endif
+	}
+
+	inline void mcFutexWakeAll(std::atomic<uint32_t>& word) noexcept {
+#if defined(__linux__)
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+		(void)word;
+#endif
+	}
 
-#if MC_CONFIG_USE_SPINLOCK == 1
-	struct SpinSharedMutex {
-		std::atomic<int> unique_lock_counter{ 0 };
-		std::atomic<int> shared_lock_counter{ 0 };
-		std::atomic_flag unique_lock_flag{ ATOMIC_FLAG_INIT };
+	/// <summary>
+	/// Writer-preferring reader/writer lock for the many-emitters/few-connections pattern. Readers take it with one CAS.
+	/// A waiting writer stops new readers. Both sides spin a little with CPU pause hints and then sleep on a futex.
+	/// </summary>
+	class McAdaptiveSharedMutex {
+	public:
+		McLockMetrics metrics; //collected if MC_ENABLE_METRICS is 1
 
 		inline void lock() noexcept {
-			while (unique_lock_flag.test_and_set(std::memory_order_acquire));
-			++unique_lock_counter;
-			while (shared_lock_counter);
+			m_writers.lock(); //the other writers sleep here
+			uint32_t state = m_state.fetch_or(writer_waiting, std::memory_order_acquire) | writer_waiting;
+			if (state & readers_mask) {
+#if MC_ENABLE_METRICS
+				const auto start = std::chrono::steady_clock::now();
+#endif
+				for (size_t spins = 0; state & readers_mask; state = m_state.load(std::memory_order_acquire)) {
+					if (spins < max_spins) {
+						++spins;
+						mcCpuRelax();
+					}else {
+						park(state);
+					}
+				}
+#if MC_ENABLE_METRICS
+				metrics.record(start);
+#endif
+			}
+			m_state.store(writer_active, std::memory_order_relaxed); //readers don't touch the state while a writer is waiting
 		}
 		inline void unlock() noexcept {
-			--unique_lock_counter;
-			unique_lock_flag.clear(std::memory_order_release);
+			m_state.store(0, std::memory_order_release);
+			wakeAll();
+			m_writers.unlock();
 		}
 
 		inline void lock_shared() noexcept {
-			while (unique_lock_counter);
-			++shared_lock_counter;
+			uint32_t state = m_state.load(std::memory_order_relaxed);
+			if ((state & writer_mask) || !m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+				lockSharedSlow();
+			}
 		}
 		inline void unlock_shared() noexcept {
-			--shared_lock_counter;
+			const uint32_t state = m_state.fetch_sub(1, std::memory_order_release);
+			if ((state & readers_mask) == 1 && (state & writer_waiting)) {
+				wakeAll(); //the last reader lets the writer in
+			}
+		}
+
+	private:
+		static constexpr uint32_t writer_active = 1u << 31;
+		static constexpr uint32_t writer_waiting = 1u << 30;
+		static constexpr uint32_t writer_mask = writer_active | writer_waiting;
+		static constexpr uint32_t readers_mask = writer_waiting - 1;
+		static constexpr size_t max_spins = 64;
+
+		std::atomic<uint32_t> m_state{ 0 }; //writer bits and the number of readers
+		std::atomic<uint32_t> m_sleepers{ 0 };
+		std::mutex m_writers;
+
+		void lockSharedSlow() noexcept {
+#if MC_ENABLE_METRICS
+			const auto start = std::chrono::steady_clock::now();
+#endif
+			for (size_t spins = 0;;) {
+				uint32_t state = m_state.load(std::memory_order_relaxed);
+				if (!(state & writer_mask)) {
+					if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+						break;
+					}
+				}else if (spins < max_spins) {
+					++spins;
+					mcCpuRelax();
+				}else {
+					park(state);
+				}
+			}
+#if MC_ENABLE_METRICS
+			metrics.record(start);
+#endif
+		}
+
+		//Store-load on both sides (the sleeper counter then the state here, the state then the counter in wakeAll()), so only the fences
+		//make sure that either the waker sees the sleeper or the futex sees the new state
+		inline void park(uint32_t state) noexcept {
+			m_sleepers.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			mcFutexWait(m_state, state);
+			m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+		}
+		//Called after the state is changed
+		inline void wakeAll() noexcept {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_sleepers.load(std::memory_order_relaxed)) {
+				mcFutexWakeAll(m_state);
+			}
 		}
 	};
-#else
-	struct SpinSharedMutex {
-		std::atomic<int> unique_lock_counter{ 0 }; //To avoid situation when shared_lock is alwais get the lock and unique_lock is wait most time
+
+	/// <summary>
+	/// std::shared_mutex as a lock policy, for comparison and for the platforms it is better on
+	/// </summary>
+	struct McStdSharedMutex {
 		std::shared_mutex mutex;
+		McLockMetrics metrics; //collected if MC_ENABLE_METRICS is 1
 
 		inline void lock() noexcept {
-			++unique_lock_counter;
+#if MC_ENABLE_METRICS
+			if (!mutex.try_lock()) {
+				const auto start = std::chrono::steady_clock::now();
+				mutex.lock();
+				metrics.record(start);
+			}
+#else
 			mutex.lock();
+#endif
 		}
 		inline void unlock() noexcept {
-			--unique_lock_counter;
 			mutex.unlock();
 		}
 
 		inline void lock_shared() noexcept {
-			while (unique_lock_counter);
+#if MC_ENABLE_METRICS
+			if (!mutex.try_lock_shared()) {
+				const auto start = std::chrono::steady_clock::now();
+				mutex.lock_shared();
+				metrics.record(start);
+			}
+#else
 			mutex.lock_shared();
+#endif
 		}
 		inline void unlock_shared() noexcept {
 			mutex.unlock_shared();
 		}
 	};
-#endif
 
 	/// <summary>
-	/// Dynamic arguments dispatcher. Found here: https://rextester.com/AKLW78695
-	/// A little modifed to be able to work with lambdas.
-	/// It allows to create virtual functions with variadic number of arguments
+	/// Statistics of McSlabPool. A hit is an allocation served by the free list of the calling thread,
+	/// a miss needs the shared free list or a new slab, an oversized one goes to operator new.
 	/// </summary>
-	template <typename F>
-	struct ArgumentPack;
+	struct McPoolStats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t oversized = 0;
+	};
 
-	struct Argument
-	{
+	/// <summary>
+	/// Size-class slab pool for the small blocks multicall allocates on connect/disconnect (callables, snapshots, index nodes).
+	/// Every thread allocates from and frees to its own free lists without any synchronization. A thread refills its lists from
+	/// the shared free lists or a new slab under a mutex, and gives the blocks back to them when it has too many or exits.
+	/// Blocks may be freed by any thread. Slabs are never returned to the system.
+	/// The statistics are counted per thread too, stats() sums them.
+	/// </summary>
+	class McSlabPool {
 	public:
-		template <typename Signature, typename Derived>
-		inline void try_to_dispatch(Derived& x, Signature(Derived::* fp)) const	{
-			auto pack = dynamic_cast<ArgumentPack<Signature> const*>(this);
-			assert(pack && "Viable function not found!");
-			pack->dispatch(x, fp);
+		static constexpr size_t granularity = alignof(std::max_align_t);
+		static constexpr size_t max_block_size = 512;
+
+		static inline void* allocate(size_t size, size_t alignment = granularity) {
+			if (size > max_block_size || alignment > granularity) {
+				count(Oversized);
+				return ::operator new(size, std::align_val_t(alignment));
+			}
+			const size_t size_class = sizeClass(size);
+			if (t_cache.dead) {
+				count(Misses);
+				return refill(size_class); //the thread is exiting, its lists are gone
+			}
+			FreeList& list = t_cache.lists[size_class];
+			if (!list.head) {
+				count(Misses);
+				return refill(size_class);
+			}
+			count(Hits);
+			FreeBlock* block = list.head;
+			list.head = block->next;
+			--list.count;
+			return block;
+		}
+
+		static inline void deallocate(void* ptr, size_t size, size_t alignment = granularity) noexcept {
+			if (size > max_block_size || alignment > granularity) {
+				::operator delete(ptr, std::align_val_t(alignment));
+				return;
+			}
+			const size_t size_class = sizeClass(size);
+			FreeBlock* block = static_cast<FreeBlock*>(ptr);
+			if (t_cache.dead) {
+				std::lock_guard locker(central().mutex);
+				block->next = central().lists[size_class];
+				central().lists[size_class] = block;
+				return;
+			}
+			FreeList& list = t_cache.lists[size_class];
+			block->next = list.head;
+			list.head = block;
+			if (++list.count == 1) {
+				t_flusher.arm(); //a thread that only frees must flush too
+			}else if (list.count > max_cached_blocks) {
+				release(size_class, max_cached_blocks / 2); //blocks freed by a thread that doesn't allocate them go back
+			}
 		}
 
-		template <typename Signature, typename F>
-		inline void try_to_dispatch(F& fp) const {
-			auto pack = dynamic_cast<ArgumentPack<Signature> const*>(this);
-			assert(pack && "Viable function not found!");
-			pack->dispatch(fp);
+		//Sums the counters of the running threads and of the exited ones
+		static inline McPoolStats stats() noexcept {
+			Central& shared = central();
+			std::lock_guard locker(shared.mutex);
+			uint64_t counts[counter_count];
+			std::copy(shared.exited, shared.exited + counter_count, counts);
+			for (const ThreadCache* cache = shared.threads; cache; cache = cache->next) {
+				for (size_t i = 0; i < counter_count; ++i) {
+					counts[i] += cache->counters[i].load(std::memory_order_relaxed);
+				}
+			}
+			return McPoolStats{ counts[Hits], counts[Misses], counts[Oversized] };
 		}
 
-		inline virtual ~Argument()	{}
-	};
+	private:
+		static constexpr size_t class_count = max_block_size / granularity;
+		static constexpr size_t slab_size = 64 * 1024;
+		static constexpr size_t refill_count = 32;
+		static constexpr size_t max_cached_blocks = 256;
 
-	template <typename ...Args>
-	struct ArgumentPack<void(Args...)>
-		: Argument, std::tuple<Args...>
-	{
-		using std::tuple<Args...>::tuple;
+		struct FreeBlock {
+			FreeBlock* next;
+		};
+		struct FreeList {
+			FreeBlock* head;
+			size_t count;
+		};
+		enum Counter : size_t { Hits, Misses, Oversized, counter_count };
+		//Trivially destructible, so it is still usable while the thread's other objects are destroyed
+		struct ThreadCache {
+			FreeList lists[class_count];
+			std::atomic<uint64_t> counters[counter_count]; //written by the thread only, so counting is a plain load and store. stats() reads them under the central mutex
+			ThreadCache* prev; //in Central::threads once the thread counts something
+			ThreadCache* next;
+			bool registered;
+			bool dead;
+		};
+		struct ThreadCacheFlusher {
+			inline void arm() noexcept {}
+			~ThreadCacheFlusher() {
+				for (size_t i = 0; i < class_count; ++i) {
+					release(i, t_cache.lists[i].count);
+				}
+				ThreadCache& cache = t_cache;
+				Central& shared = central();
+				std::lock_guard locker(shared.mutex);
+				if (cache.registered) {
+					for (size_t i = 0; i < counter_count; ++i) {
+						shared.exited[i] += cache.counters[i].load(std::memory_order_relaxed);
+					}
+					(cache.prev ? cache.prev->next : shared.threads) = cache.next;
+					if (cache.next) {
+						cache.next->prev = cache.prev;
+					}
+					cache.registered = false;
+				}
+				cache.dead = true;
+			}
+		};
+		struct Central {
+			std::mutex mutex;
+			FreeBlock* lists[class_count] = {};
+			ThreadCache* threads = nullptr; //the caches of the running threads that count
+			uint64_t exited[counter_count] = {}; //the counts of the exited threads and of the ones exiting
+		};
+
+		static inline thread_local ThreadCache t_cache{};
+		static inline thread_local ThreadCacheFlusher t_flusher;
 
-		template <typename Derived, typename F>
-		inline void dispatch(Derived& x, F(Derived::* fp)) const {
-			dispatch(x, fp, std::make_index_sequence<sizeof...(Args)>{});
+		static inline size_t sizeClass(size_t size) noexcept { return size ? (size - 1) / granularity : 0; }
+
+		static inline void count(Counter counter) {
+			ThreadCache& cache = t_cache;
+			if (cache.dead) {
+				std::lock_guard locker(central().mutex); //rare: allocations of the thread_local destructors that run after the flush
+				++central().exited[counter];
+				return;
+			}
+			if (!cache.registered) {
+				t_flusher.arm(); //registers the flush, which takes the counters out of the list at the thread exit
+				Central& shared = central();
+				std::lock_guard locker(shared.mutex);
+				cache.next = shared.threads;
+				if (shared.threads) {
+					shared.threads->prev = &cache;
+				}
+				shared.threads = &cache;
+				cache.registered = true;
+			}
+			std::atomic<uint64_t>& value = cache.counters[counter];
+			value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 		}
 
-		template <typename F>
-		inline void dispatch(F& fp) const {
-			dispatch(fp, std::make_index_sequence<sizeof...(Args)>{});
+		//Never destroyed: blocks may be freed during the static destruction
+		static inline Central& central() {
+			static Central* central = new Central;
+			return *central;
 		}
 
-	private:
-		template <typename Derived, typename F, size_t ...Indexes>
-		inline void dispatch(Derived& x, F(Derived::* fp), std::index_sequence<Indexes...>) const {
-			(x.*fp)(std::get<Indexes>(*this)...);
+		//count() has registered the flush at the thread exit
+		static inline void* refill(size_t size_class) {
+			const size_t block_size = (size_class + 1) * granularity;
+			Central& shared = central();
+			std::lock_guard locker(shared.mutex);
+			if (!shared.lists[size_class]) {
+				uint8_t* slab = static_cast<uint8_t*>(::operator new(slab_size));
+				for (size_t offset = 0; offset + block_size <= slab_size; offset += block_size) {
+					FreeBlock* block = reinterpret_cast<FreeBlock*>(slab + offset);
+					block->next = shared.lists[size_class];
+					shared.lists[size_class] = block;
+				}
+			}
+			FreeBlock* result = shared.lists[size_class];
+			shared.lists[size_class] = result->next;
+			if (!t_cache.dead) {
+				FreeList& list = t_cache.lists[size_class];
+				for (size_t i = 0; i < refill_count && shared.lists[size_class]; ++i) {
+					FreeBlock* block = shared.lists[size_class];
+					shared.lists[size_class] = block->next;
+					block->next = list.head;
+					list.head = block;
+					++list.count;
+				}
+			}
+			return result;
 		}
 
-		template <typename F, size_t ...Indexes>
-		inline void dispatch(F& fp, std::index_sequence<Indexes...>) const {
-			fp(std::get<Indexes>(*this)...);
+		static inline void release(size_t size_class, size_t count) noexcept {
+			FreeList& list = t_cache.lists[size_class];
+			Central& shared = central();
+			std::lock_guard locker(shared.mutex);
+			for (; count && list.head; --count) {
+				FreeBlock* block = list.head;
+				list.head = block->next;
+				--list.count;
+				block->next = shared.lists[size_class];
+				shared.lists[size_class] = block;
+			}
 		}
 	};
 
+	/// <summary>
+	/// Allocator policies. MC_ALLOCATOR selects the one multicall uses, define it before including this header to replace the default.
+	/// A policy is a class with static allocate(size, alignment) and deallocate(ptr, size, alignment).
+	/// </summary>
+	struct McSlabAllocator {
+		static inline void* allocate(size_t size, size_t alignment) { return McSlabPool::allocate(size, alignment); }
+		static inline void deallocate(void* ptr, size_t size, size_t alignment) noexcept { McSlabPool::deallocate(ptr, size, alignment); }
+	};
+
+	struct McHeapAllocator {
+		static inline void* allocate(size_t size, size_t alignment) { return ::operator new(size, std::align_val_t(alignment)); }
+		static inline void deallocate(void* ptr, size_t, size_t alignment) noexcept { ::operator delete(ptr, std::align_val_t(alignment)); }
+	};
+
+#if !defined(MC_ALLOCATOR)
+	#define MC_ALLOCATOR ::multicall::McSlabAllocator
+#endif
+
+	/// <summary>
+	/// Standard allocator over MC_ALLOCATOR, for the containers and shared pointers of the connection bookkeeping
+	/// </summary>
+	template<class T>
+	struct McAllocator {
+		using value_type = T;
+
+		McAllocator() = default;
+		template<class U>
+		McAllocator(const McAllocator<U>&) noexcept {}
+
+		inline T* allocate(size_t count) { return static_cast<T*>(MC_ALLOCATOR::allocate(count * sizeof(T), alignof(T))); }
+		inline void deallocate(T* ptr, size_t count) noexcept { MC_ALLOCATOR::deallocate(ptr, count * sizeof(T), alignof(T)); }
+
+		template<class U>
+		inline bool operator == (const McAllocator<U>&) const noexcept { return true; }
+		template<class U>
+		inline bool operator != (const McAllocator<U>&) const noexcept { return false; }
+	};
+
+	template<class T, class ...Args>
+	inline std::shared_ptr<T> McMakeShared(Args&& ...args) {
+		return std::allocate_shared<T>(McAllocator<std::remove_const_t<T>>(), std::forward<Args>(args)...);
+	}
+
+	/// <summary>
+	/// Gives a polymorphic base class operator new/delete over MC_ALLOCATOR. The virtual destructor passes the real size to delete.
+	/// </summary>
+	struct McPoolAllocated {
+		static inline void* operator new(size_t size) { return MC_ALLOCATOR::allocate(size, alignof(std::max_align_t)); }
+		static inline void operator delete(void* ptr, size_t size) noexcept { MC_ALLOCATOR::deallocate(ptr, size, alignof(std::max_align_t)); }
+		static inline void* operator new(size_t, void* place) noexcept { return place; }
+		static inline void operator delete(void*, void*) noexcept {}
+	};
+
 	class McFunctionId;
 	class MultiCallBase;
 
-	class McFunctionIdImpl final {
+	/// <summary>
+	/// Unique address per signature. Used instead of RTTI to check that a callback is called with the arguments it was created for.
+	/// </summary>
+	template<class ...Args>
+	struct McSignatureTag {
+		static inline const char id = 0;
+	};
+
+	/// <summary>
+	/// True if the arguments of a signal can be copied. The subscribers that keep the arguments (queued, latest, batch) and
+	/// McEmitParallel() share one copy of them, so they require it.
+	/// </summary>
+	template<class ...Args>
+	struct McCopyableArgs : std::bool_constant<(std::is_copy_constructible_v<std::decay_t<Args>> && ...)> {};
+
+	/// <summary>
+	/// The arguments of one emit. They are packed once and every subscriber gets references to them, the last direct subscriber
+	/// may take them by move. The subscribers that keep the arguments (queued, latest...) share one immutable copy made by shared().
+	/// </summary>
+	template<class ...Args>
+	class McEmitArgs {
 	public:
-		McFunctionIdImpl() = default;
-		inline ~McFunctionIdImpl() noexcept { deleteImpl(); }
-		inline McFunctionIdImpl(const McFunctionIdImpl& other) noexcept : m_impl(other.clone_impl_to(m_small_starage_buffer)) {}
-		inline McFunctionIdImpl(McFunctionIdImpl&& other) noexcept : m_impl(other.move_impl_to(m_small_starage_buffer)) {}
+		using Values = std::tuple<std::decay_t<Args>...>;
 
-		inline McFunctionIdImpl& operator = (const McFunctionIdImpl& other) noexcept {
-			if (&other == this) { return *this; }
-			deleteImpl();
-			m_impl = other.clone_impl_to(m_small_starage_buffer);
-			return *this;
+		//The arguments are owned by the emitter
+		explicit McEmitArgs(std::remove_reference_t<Args>& ...args) noexcept : m_refs(args...) {}
+		//The arguments are kept by a shared pack, they are never moved
+		explicit McEmitArgs(std::shared_ptr<const Values> values) noexcept : McEmitArgs(*values, std::index_sequence_for<Args...>{}) { m_shared = std::move(values); }
+		explicit McEmitArgs(const Values& values) noexcept : McEmitArgs(values, std::index_sequence_for<Args...>{}) {}
+
+		McEmitArgs(const McEmitArgs&) = delete;
+		McEmitArgs& operator = (const McEmitArgs&) = delete;
+
+		//Lets the next subscriber take the arguments by move. McEmit() does it for the last one.
+		inline void setMovable(bool movable) noexcept { m_movable = movable && m_owned; }
+
+		template<size_t I>
+		inline decltype(auto) get() const noexcept {
+			if constexpr (std::is_lvalue_reference_v<Arg<I>>) {
+				return std::get<I>(m_refs);
+			}else {
+				return std::as_const(std::get<I>(m_refs));
+			}
 		}
-		inline McFunctionIdImpl& operator = (McFunctionIdImpl&& other) noexcept {
-			if (&other == this) { return *this; }
-			deleteImpl();
-			m_impl = other.move_impl_to(m_small_starage_buffer);
-			return *this;
+
+		template<size_t I>
+		inline decltype(auto) take() const noexcept {
+			if constexpr (std::is_lvalue_reference_v<Arg<I>>) {
+				return std::get<I>(m_refs);
+			}else {
+				return std::move(std::get<I>(m_refs));
+			}
 		}
 
-		inline bool isValid() const noexcept { return bool(m_impl); }
+		//Calls function(prefix..., arguments...). The arguments are moved if it's allowed and the function takes them by value.
+		template<class F, class ...Prefix>
+		inline void apply(F&& function, Prefix&& ...prefix) const noexcept {
+			applyImpl(std::index_sequence_for<Args...>{}, std::forward<F>(function), std::forward<Prefix>(prefix)...);
+		}
 
-		template<class ...Args>
-		inline void call(Args && ...args) const noexcept {
-			const Argument& a = ArgumentPack<void(Args...)>(std::forward<Args>(args)...);
-			m_impl->call(a);
+		//Returns function(arguments...). The arguments are never moved, so the subscribers still get them afterwards.
+		template<class F>
+		inline decltype(auto) inspect(F&& function) const {
+			return inspectImpl(std::index_sequence_for<Args...>{}, std::forward<F>(function));
 		}
 
-		struct InternalImplBase {
-			virtual ~InternalImplBase() = default;
-			virtual InternalImplBase* clone_to(void* buffer) noexcept = 0;
-			virtual InternalImplBase* clone_to() noexcept = 0;
-			virtual InternalImplBase* move_to(void* buffer) noexcept = 0;
-			virtual InternalImplBase* move_to() noexcept = 0;
+		//One immutable copy of the arguments for all the subscribers of this emit that keep them
+		inline const std::shared_ptr<const Values>& shared() const {
+			if (!m_shared) {
+				m_shared = makeShared(std::index_sequence_for<Args...>{});
+			}
+			return m_shared;
+		}
 
-			virtual std::pair<const uint8_t* const, size_t> rawData() const noexcept = 0;
-			virtual MultiCallBase* getObject() const noexcept = 0;
+	private:
+		template<size_t I>
+		using Arg = std::tuple_element_t<I, std::tuple<Args...>>;
 
-			virtual void call(const Argument&) const noexcept = 0;
+		std::tuple<std::remove_reference_t<Args>&...> m_refs;
+		mutable std::shared_ptr<const Values> m_shared;
+		bool m_owned = true;
+		bool m_movable = false;
 
-			inline size_t hash() const noexcept {
-				const auto [data, size] = rawData();
-				size_t result = 0;
-				if (size % sizeof(size_t) == 0) {
-					const size_t new_size = size / sizeof(size_t);
-					const size_t* new_data = reinterpret_cast<const size_t*>(data);
-					for (size_t i = 0; i < new_size; ++i) {
-						hash_combine(result, new_data[i]);
-					}
-				}else {
-					for (size_t i = 0; i < size; ++i) {
-						hash_combine(result, data[i]);
-					}
-				}
-				return result;
-			};
-			inline bool compare(InternalImplBase* other) const noexcept {
-				const auto [data, size] = rawData();
-				const auto [other_data, other_size] = other->rawData();
-				if (size == other_size) {
-					if (memcmp(data, other_data, size) == 0) {
-						return true;
-					}
+		template<size_t ...I>
+		McEmitArgs(const Values& values, std::index_sequence<I...>) noexcept : m_refs(const_cast<std::decay_t<Args>&>(std::get<I>(values))...), m_owned(false) {
+			static_assert(McCopyableArgs<Args...>::value, "A pack shared by several subscribers needs copyable arguments");
+		}
+
+		template<size_t ...I, class F, class ...Prefix>
+		inline void applyImpl(std::index_sequence<I...>, F&& function, Prefix&& ...prefix) const noexcept {
+			constexpr bool by_move = std::is_invocable_v<F, Prefix..., decltype(take<I>())...>;
+			constexpr bool by_copy = std::is_invocable_v<F, Prefix..., decltype(get<I>())...>;
+			static_assert(by_move || by_copy, "The subscriber doesn't take the arguments of the signal");
+			if constexpr (by_move) {
+				//A move-only argument taken by value is moved even into a subscriber that isn't the last one: the later ones get what is left of it.
+				//Only the packs of the emitter can get here (the shared ones are copyable), so the subscriber is never skipped.
+				if (m_movable || !by_copy) {
+					std::invoke(std::forward<F>(function), std::forward<Prefix>(prefix)..., take<I>()...);
+					return;
 				}
-				return false;
 			}
-			template <class T>
-			inline void hash_combine(std::size_t& s, const T& v) const noexcept {
-				static const std::hash<T> h;
-				s ^= h(v) + 0x9e3779b9 + (s << 6) + (s >> 2);
+			if constexpr (by_copy) {
+				std::invoke(std::forward<F>(function), std::forward<Prefix>(prefix)..., get<I>()...);
 			}
-		};
+		}
 
-		template<class T, class F>
+		template<size_t ...I, class F>
+		inline decltype(auto) inspectImpl(std::index_sequence<I...>, F&& function) const {
+			return std::invoke(std::forward<F>(function), get<I>()...);
+		}
+
+		template<size_t ...I>
+		inline std::shared_ptr<const Values> makeShared(std::index_sequence<I...>) const {
+			static_assert(McCopyableArgs<Args...>::value, "The subscribers that keep the arguments (queued, latest, batch, McEmitParallel()) need copyable arguments");
+			if (m_movable) {
+				return McMakeShared<const Values>(take<I>()...);
+			}
+			return McMakeShared<const Values>(get<I>()...);
+		}
+	};
+
+	/// <summary>
+	/// True if a callback parameter of type Param can be bound to a signal argument of type Arg
+	/// </summary>
+	template<class Arg, class Param>
+	struct McParamAccepts : std::bool_constant<std::is_same_v<std::decay_t<Arg>, std::decay_t<Param>> &&
+		(!std::is_lvalue_reference_v<Param> || std::is_const_v<std::remove_reference_t<Param>> || std::is_lvalue_reference_v<Arg>) &&
+		(!std::is_rvalue_reference_v<Param> || std::is_rvalue_reference_v<Arg>)> {};
+
+	template<class Args, class Params>
+	struct McParamsAccept : std::false_type {};
+	template<class ...Args, class ...Params>
+	struct McParamsAccept<std::tuple<Args...>, std::tuple<Params...>> : std::bool_constant<sizeof...(Args) == sizeof...(Params) && (McParamAccepts<Args, Params>::value && ...)> {};
+
+	template<class T>
+	MultiCallBase* __mcToMultiCallBase(T* obj) noexcept;
+
+	/// <summary>
+	/// Read-only view of a burst of events of a signal, each event is a tuple of the arguments. Used by McEmitBatch().
+	/// </summary>
+	template<class ...Args>
+	class McBatch {
+	public:
+		using Event = std::tuple<std::decay_t<Args>...>;
+
+		McBatch() = default;
+		McBatch(const Event* data, size_t size) noexcept : m_data(data), m_size(size) {}
+		McBatch(const std::vector<Event>& events) noexcept : m_data(events.data()), m_size(events.size()) {}
+		template<size_t N>
+		McBatch(const Event(&events)[N]) noexcept : m_data(events), m_size(N) {}
+
+		inline const Event* data() const noexcept { return m_data; }
+		inline size_t size() const noexcept { return m_size; }
+		inline bool empty() const noexcept { return m_size == 0; }
+		inline const Event* begin() const noexcept { return m_data; }
+		inline const Event* end() const noexcept { return m_data + m_size; }
+		inline const Event& operator [] (size_t index) const noexcept { return m_data[index]; }
+
+	private:
+		const Event* m_data = nullptr;
+		size_t m_size = 0;
+	};
+
+	/// <summary>
+	/// Type-erased reference to a callable: the thunk and the object it has to be called with.
+	/// That's everything McEmit() needs to call a subscriber, so subscribers lists are packed arrays of it.
+	/// </summary>
+	struct McSubscriberEntry {
+		using ErasedThunk = void(*)();
+		template<class ...Args>
+		using Thunk = void(*)(const void*, const McEmitArgs<Args...>&);
+
+		const void* object = nullptr;
+		ErasedThunk thunk = nullptr;
+
+		//Args must be exactly the signature the thunk was created for
+		template<class ...Args>
+		inline void call(const McEmitArgs<Args...>& args) const noexcept {
+			reinterpret_cast<Thunk<Args...>>(thunk)(object, args);
+		}
+	};
+
+
+	/// <summary>
+	/// Type-erased callable with InlineSize bytes of inline storage. Bigger callables are allocated by MC_ALLOCATOR,
+	/// or don't compile at all if InlineOnly is set, so it is a fixed-capacity inline callable then.
+	/// </summary>
+	template<size_t InlineSize, bool InlineOnly>
+	class McBasicFunctionIdImpl final {
+	public:
+		McBasicFunctionIdImpl() = default;
+		inline ~McBasicFunctionIdImpl() noexcept { deleteImpl(); }
+		inline McBasicFunctionIdImpl(const McBasicFunctionIdImpl& other) noexcept : m_key(other.m_key), m_thunk(other.m_thunk), m_signature(other.m_signature) { copyImpl(other); }
+		inline McBasicFunctionIdImpl(McBasicFunctionIdImpl&& other) noexcept : m_key(other.m_key), m_thunk(other.m_thunk), m_signature(other.m_signature) { moveImpl(other); }
+
+		inline McBasicFunctionIdImpl& operator = (const McBasicFunctionIdImpl& other) noexcept {
+			if (&other == this) { return *this; }
+			deleteImpl();
+			copyImpl(other);
+			m_key = other.m_key;
+			m_thunk = other.m_thunk;
+			m_signature = other.m_signature;
+			return *this;
+		}
+		inline McBasicFunctionIdImpl& operator = (McBasicFunctionIdImpl&& other) noexcept {
+			if (&other == this) { return *this; }
+			deleteImpl();
+			moveImpl(other);
+			m_key = other.m_key;
+			m_thunk = other.m_thunk;
+			m_signature = other.m_signature;
+			return *this;
+		}
+
+		inline bool isValid() const noexcept { return bool(m_impl); }
+
+		//Args must be exactly the signature the content was set with. It is guaranteed by Connect(), so no runtime type query is done here.
+		template<class ...Args>
+		inline void call(const McEmitArgs<Args...>& args) const noexcept {
+			assert(m_signature == &McSignatureTag<Args...>::id && "Viable function not found!");
+			entry().call(args);
+		}
+
+		//Valid while this object is alive and isn't changed
+		inline McSubscriberEntry entry() const noexcept { return McSubscriberEntry{ m_impl, m_thunk }; }
+
+		struct InternalImplBase : McPoolAllocated {
+			virtual ~InternalImplBase() = default;
+			virtual InternalImplBase* clone_to(void* buffer) noexcept = 0;
+			virtual InternalImplBase* clone_to() noexcept = 0;
+			virtual InternalImplBase* move_to(void* buffer) noexcept = 0;
+
+			static inline size_t hash(const uint8_t* data, size_t size) noexcept {
+				size_t result = 0;
+				if (size % sizeof(size_t) == 0) {
+					const size_t new_size = size / sizeof(size_t);
+					const size_t* new_data = reinterpret_cast<const size_t*>(data);
+					for (size_t i = 0; i < new_size; ++i) {
+						hash_combine(result, new_data[i]);
+					}
+				}else {
+					for (size_t i = 0; i < size; ++i) {
+						hash_combine(result, data[i]);
+					}
+				}
+				return result;
+			};
+			template <class T>
+			static inline void hash_combine(std::size_t& s, const T& v) noexcept {
+				static const std::hash<T> h;
+				s ^= h(v) + 0x9e3779b9 + (s << 6) + (s >> 2);
+			}
+		};
+
+		template<class T, class F>
 		struct IdMemberStorage {
 			T* object;
 			F func;
@@ -225,23 +1030,16 @@ namespace multicall
 			virtual InternalImplBase* clone_to(void* buffer) noexcept { return new(buffer) InternalImplMember<T, F, Args...>(*this); }; //for placement new only!
 			virtual InternalImplBase* clone_to() noexcept {return new InternalImplMember<T, F, Args...>(*this);};
 			virtual InternalImplBase* move_to(void* buffer) noexcept { return new(buffer) InternalImplMember<T, F, Args...>(std::move(*this)); }; //for placement new only!
-			virtual InternalImplBase* move_to() noexcept { return this; };
 			
 			union RawData {
 				IdMemberStorage<T, F> storage;
 				uint8_t data[sizeof(IdMemberStorage<T, F>)];
 			};
 			RawData raw_data;
-			inline std::pair<const uint8_t* const, size_t> rawData() const noexcept override {
-				return std::make_pair(raw_data.data, sizeof(raw_data.data));
-			}
-			inline MultiCallBase* getObject() const noexcept override {
-				MultiCallBase* base_prt = dynamic_cast<MultiCallBase*>(raw_data.storage.object);
-				return base_prt;
-			}
 
-			inline void call(const Argument& args) const noexcept override {
-				args.try_to_dispatch<void(Args...)>(*raw_data.storage.object, raw_data.storage.func);
+			static void invoke(const void* impl, const McEmitArgs<Args...>& args) noexcept {
+				const IdMemberStorage<T, F>& storage = static_cast<const InternalImplMember*>(static_cast<const InternalImplBase*>(impl))->raw_data.storage;
+				args.apply(storage.func, storage.object);
 			}
 		};
 
@@ -251,316 +1049,2109 @@ namespace multicall
 			virtual InternalImplBase* clone_to(void* buffer) noexcept { return new(buffer) InternalImplFunction<F, Args...>(*this); }; //for placement new only!
 			virtual InternalImplBase* clone_to() noexcept { return new InternalImplFunction<F, Args...>(*this); };
 			virtual InternalImplBase* move_to(void* buffer) noexcept { return new(buffer) InternalImplFunction<F, Args...>(std::move(*this)); }; //for placement new only!
-			virtual InternalImplBase* move_to() noexcept { return this; };
 
 			union RawData {
 				IdFunctionStorage<F> storage;
 				uint8_t data[sizeof(IdFunctionStorage<F>)];
 			};
 			RawData raw_data;
-			inline std::pair<const uint8_t* const, size_t> rawData() const noexcept override {
-				return std::make_pair(raw_data.data, sizeof(raw_data.data));
+
+			static void invoke(const void* impl, const McEmitArgs<Args...>& args) noexcept {
+				args.apply(static_cast<const InternalImplFunction*>(static_cast<const InternalImplBase*>(impl))->raw_data.storage.func);
 			}
-			inline MultiCallBase* getObject() const noexcept override {
-				return nullptr;
+		};
+
+		template<class Impl>
+		static constexpr bool fitsInline = sizeof(Impl) <= InlineSize && alignof(Impl) <= alignof(size_t);
+		//True if the callable F is stored without a heap allocation
+		template<class F>
+		static constexpr bool fitsInlineFunction = fitsInline<InternalImplFunction<F>>;
+
+	private:
+		using ErasedThunk = McSubscriberEntry::ErasedThunk;
+		template<class ...Args>
+		using Thunk = McSubscriberEntry::Thunk<Args...>;
+
+		/// <summary>
+		/// Everything the lookups need, computed once when the content is set: the MultiCallBase of the object (nullptr for functions),
+		/// the hash of the raw bytes of the callable and where these bytes are in the content, so comparing needs no virtual call.
+		/// </summary>
+		struct Key {
+			MultiCallBase* object = nullptr;
+			size_t hash = 0;
+			uint32_t raw_offset = 0;
+			uint32_t raw_size = 0;
+		};
+
+		InternalImplBase* m_impl = nullptr;
+		Key m_key;
+		ErasedThunk m_thunk = nullptr; //Thunk<Args...> of the content, called directly without virtual dispatch
+		const char* m_signature = nullptr; //&McSignatureTag<Args...>::id of the content
+		bool m_on_heap = false; //m_impl is allocated by MC_ALLOCATOR, otherwise it is constructed in m_small_starage_buffer
+		alignas(size_t) uint8_t m_small_starage_buffer[InlineSize];
+
+		void deleteImpl() noexcept {
+			if (m_impl) {
+				if (m_on_heap) {
+					delete m_impl;
+				}else {
+					m_impl->~InternalImplBase(); //placement new was used
+				}
+				m_impl = nullptr;
+				m_on_heap = false;
+			}
+			m_key = Key{};
+		}
+
+		template<class Impl>
+		inline void setKey(const Impl* impl, MultiCallBase* object) noexcept {
+			const uint8_t* raw = impl->raw_data.data;
+			m_key.object = object;
+			m_key.raw_offset = uint32_t(raw - reinterpret_cast<const uint8_t*>(static_cast<const InternalImplBase*>(impl)));
+			m_key.raw_size = uint32_t(sizeof(impl->raw_data.data));
+			m_key.hash = InternalImplBase::hash(raw, m_key.raw_size);
+		}
+
+		inline const uint8_t* rawData() const noexcept { return reinterpret_cast<const uint8_t*>(m_impl) + m_key.raw_offset; }
+
+		//this must be empty
+		void copyImpl(const McBasicFunctionIdImpl& other) noexcept {
+			if (other.m_impl) {
+				m_impl = other.m_on_heap ? other.m_impl->clone_to() : other.m_impl->clone_to(m_small_starage_buffer);
+				m_on_heap = other.m_on_heap;
+			}
+		}
+
+		//this must be empty. A heap content is just handed over.
+		void moveImpl(McBasicFunctionIdImpl& other) noexcept {
+			if (other.m_impl) {
+				if (other.m_on_heap) {
+					m_impl = other.m_impl;
+					m_on_heap = true;
+					other.m_impl = nullptr;
+					other.m_on_heap = false;
+				}else {
+					m_impl = other.m_impl->move_to(m_small_starage_buffer);
+				}
+			}
+		}
+
+		friend McFunctionId;
+
+		template<class ...Args, class T, class F>
+		inline void setContent(T* obj, F func) noexcept {
+			static_assert(std::is_member_function_pointer_v<F>);
+			using Impl = InternalImplMember<T, F, Args...>;
+			deleteImpl();
+			if constexpr (fitsInline<Impl>) {
+				m_impl = new(m_small_starage_buffer) Impl(obj, func);
+			}else {
+				static_assert(!InlineOnly, "The callback doesn't fit MC_INLINE_CALLABLE_SIZE");
+				m_impl = new Impl(obj, func);
+				m_on_heap = true;
+			}
+			setKey(static_cast<const Impl*>(m_impl), __mcToMultiCallBase(obj)); //the only dynamic_cast (if any) of the callback
+			m_thunk = reinterpret_cast<ErasedThunk>(static_cast<Thunk<Args...>>(&Impl::invoke));
+			m_signature = &McSignatureTag<Args...>::id;
+		}
+		template<class ...Args, class F>
+		inline void setContent(F func) noexcept {
+			using Impl = InternalImplFunction<F, Args...>;
+			deleteImpl();
+			if constexpr (fitsInline<Impl>) {
+				m_impl = new(m_small_starage_buffer) Impl(func);
+			}else {
+				static_assert(!InlineOnly, "The callback doesn't fit MC_INLINE_CALLABLE_SIZE");
+				m_impl = new Impl(func);
+				m_on_heap = true;
+			}
+			setKey(static_cast<const Impl*>(m_impl), nullptr);
+			m_thunk = reinterpret_cast<ErasedThunk>(static_cast<Thunk<Args...>>(&Impl::invoke));
+			m_signature = &McSignatureTag<Args...>::id;
+		}
+
+		//The bytes are compared only if the hashes match, so a miss is a couple of integer compares
+		inline bool operator == (const McBasicFunctionIdImpl& other) const noexcept {
+			return m_key.hash == other.m_key.hash && m_key.object == other.m_key.object && m_key.raw_size == other.m_key.raw_size &&
+				memcmp(rawData(), other.rawData(), m_key.raw_size) == 0;
+		}
+		inline size_t hash() const noexcept { return m_key.hash; }
+		inline MultiCallBase* getObject() const noexcept { return m_key.object; }
+	};
+
+	using McFunctionIdImpl = McBasicFunctionIdImpl<MC_INLINE_CALLABLE_SIZE, MC_INLINE_CALLABLES_ONLY != 0>;
+
+	/// <summary>
+	/// Wraps a callback that must be stored inline: Connect(signal, McInline(lambda)) doesn't compile if the lambda doesn't fit.
+	/// Use it on hot signals to be sure that connecting never allocates the callback.
+	/// </summary>
+	template<class F>
+	struct McInlineCallable {
+		F function;
+
+		template<class ...Args>
+		inline auto operator()(Args&& ...args) const -> decltype(function(std::forward<Args>(args)...)) {
+			return function(std::forward<Args>(args)...);
+		}
+	};
+
+	template<class F>
+	inline McInlineCallable<std::decay_t<F>> McInline(F&& function) {
+		static_assert(McFunctionIdImpl::fitsInlineFunction<McInlineCallable<std::decay_t<F>>>, "The callback doesn't fit MC_INLINE_CALLABLE_SIZE");
+		return McInlineCallable<std::decay_t<F>>{ std::forward<F>(function) };
+	}
+
+	template<class ...Args>
+	struct ArgsPlaceholder {};
+
+	class McFunctionId {
+	public:
+		McFunctionId() = default;
+
+		template<class ...Args>
+		inline McFunctionId(void(*func)(Args...)) noexcept { m_impl.setContent<Args...>(func); }
+
+		template<class ...Args, class T>
+		inline McFunctionId(T* obj, void(T::* func)(Args...)) noexcept { m_impl.setContent<Args...>(obj, func); }
+
+		template<class ...Args, class F>
+		inline McFunctionId(ArgsPlaceholder<Args...>, F func) noexcept { m_impl.setContent<Args...>(func); }
+
+		//Args is the signature of the signal, it may differ from the parameters of func (const T& for T)
+		template<class ...Args, class T, class F>
+		inline McFunctionId(ArgsPlaceholder<Args...>, T* obj, F func) noexcept { m_impl.setContent<Args...>(obj, func); }
+
+		inline bool operator == (const McFunctionId& other) const noexcept {
+			return (m_impl.isValid() && (m_impl.isValid() == other.m_impl.isValid())) ? m_impl == other.m_impl : false;
+		}
+		inline size_t hash() const noexcept { return m_impl.isValid() ? m_impl.hash() : 0; }
+		inline MultiCallBase* getObject() const noexcept { return m_impl.isValid() ? m_impl.getObject() : nullptr; }
+
+		template<class ...Args>
+		inline void call(const McEmitArgs<Args...>& args) const noexcept {
+			m_impl.call(args);
+		}
+		inline McSubscriberEntry entry() const noexcept { return m_impl.entry(); }
+
+	private:
+		McFunctionIdImpl m_impl;
+		bool m_active = true;
+	};
+
+	struct McFunctionIdHash
+	{
+		size_t operator() (const McFunctionId& k) const noexcept {
+			return k.hash();
+		}
+	};
+
+	/// <summary>
+	/// The key of a keyed connection as the deduplication compares it: by value, so keys with the same salt still differ
+	/// </summary>
+	struct McRouteKey {
+		using Equal = bool(*)(const void*, const void*) noexcept;
+
+		std::shared_ptr<const void> value;
+		Equal equal = nullptr; //compares two values of the same key type and extractor type, null for the connections without a key
+
+		inline bool operator == (const McRouteKey& other) const noexcept {
+			return equal == other.equal && (!equal || equal(value.get(), other.value.get()));
+		}
+	};
+
+	/// <summary>
+	/// McFunctionId with its hash computed once at Connect(). The subscribers index and the connection bookkeeping are keyed by it,
+	/// so McConnection::disconnect() and DisconnectFromAll() find a connection again without rehashing the callable.
+	/// </summary>
+	struct McSubscriberKey {
+		McFunctionId id;
+		size_t hash = 0;
+		size_t salt = 0; //McSubscriber::salt, the same callback may be connected once per key or filter
+		McRouteKey route_key; //McSubscriber::route_key
+
+		McSubscriberKey() = default;
+		inline explicit McSubscriberKey(const McFunctionId& id_, size_t salt_ = 0, McRouteKey route_key_ = {}) noexcept
+			: id(id_), hash(id_.hash() ^ (salt_ * 0x9e3779b97f4a7c15ull)), salt(salt_), route_key(std::move(route_key_)) {}
+
+		inline bool operator == (const McSubscriberKey& other) const noexcept {
+			return hash == other.hash && salt == other.salt && id == other.id && route_key == other.route_key;
+		}
+	};
+
+	struct McSubscriberKeyHash
+	{
+		size_t operator() (const McSubscriberKey& k) const noexcept {
+			return k.hash;
+		}
+	};
+
+	/// <summary>
+	/// Return type of the signals declared by MC_DECLARE_SIGNAL. N is the index of the signal within its interface.
+	/// </summary>
+	template<size_t N>
+	struct McSignalSlot {
+		static constexpr size_t index = N;
+	};
+
+	/// <summary>
+	/// Unique address per interface. Together with the slot index it identifies a signal without hashing.
+	/// </summary>
+	template<class T>
+	struct McInterfaceTag {
+		static inline const char id = 0;
+	};
+
+	struct McSignalId {
+		MultiCallBase* sender = nullptr;
+		const char* interface_tag = nullptr; //&McInterfaceTag<Interface>::id
+		size_t index = 0; //McSignalSlot index
+
+		inline bool operator == (const McSignalId& other) const noexcept {
+			return sender == other.sender && interface_tag == other.interface_tag && index == other.index;
+		}
+	};
+
+	struct McSignalIdHash
+	{
+		size_t operator() (const McSignalId& k) const noexcept {
+			size_t result = std::hash<const void*>()(k.sender);
+			result ^= std::hash<const void*>()(k.interface_tag) + 0x9e3779b9 + (result << 6) + (result >> 2);
+			result ^= std::hash<size_t>()(k.index) + 0x9e3779b9 + (result << 6) + (result >> 2);
+			return result;
+		}
+	};
+
+	template<class... Args>
+	struct McSignal {
+		using Batch = McBatch<Args...>;
+
+		template<class _Sender, class _Interface, size_t _Index>
+		McSignal(_Sender* obj, McSignalSlot<_Index>(_Interface::*)(Args...)) noexcept
+			: m_object(static_cast<_Interface*>(obj)), m_resolve_sender(&resolveSender<_Interface>), m_interface_tag(&McInterfaceTag<_Interface>::id), m_index(_Index)
+		{
+			static_assert(std::is_same_v<typename _Interface::__MC_IINTERFACE, _Interface>, "The type of sender must be the same as type of the interface");
+		}
+
+		//Finds the MultiCallBase of the sender, so it isn't free. McEmit() doesn't need it.
+		inline McSignalId id() const noexcept { return McSignalId{ m_resolve_sender(m_object), m_interface_tag, m_index }; }
+
+		void* m_object;
+		MultiCallBase* (*m_resolve_sender)(void*) noexcept;
+		const char* m_interface_tag;
+		size_t m_index;
+
+	private:
+		template<class _Interface>
+		static MultiCallBase* resolveSender(void* obj) noexcept { return __mcToMultiCallBase(static_cast<_Interface*>(obj)); }
+	};
+
+	/// <summary>
+	/// Where McEmit() routes a keyed subscriber: hash_thunk computes the hash of the key of the arguments with the extractor,
+	/// the subscriber is called only if it equals hash. Subscribers without a hash_thunk get every emit.
+	/// </summary>
+	struct McSubscriberRoute {
+		template<class ...Args>
+		using HashThunk = size_t(*)(McSubscriberEntry::ErasedThunk, const McEmitArgs<Args...>&);
+
+		McSubscriberEntry::ErasedThunk hash_thunk = nullptr; //HashThunk<Args...>
+		McSubscriberEntry::ErasedThunk extractor = nullptr; //passed to hash_thunk, null for the first argument
+		size_t hash = 0;
+
+		inline bool sameKeyOf(const McSubscriberRoute& other) const noexcept { return hash_thunk == other.hash_thunk && extractor == other.extractor; }
+	};
+
+	/// <summary>
+	/// A subscriber as McEmit() sees it: the entry to call and whatever keeps the entry valid while any snapshot refers to it.
+	/// </summary>
+	struct McSubscriber {
+		template<class ...Args>
+		using BatchThunk = void(*)(const void*, McBatch<Args...>);
+
+		McSubscriberEntry entry;
+		std::shared_ptr<const void> owner;
+		McSubscriberEntry::ErasedThunk batch_thunk = nullptr; //BatchThunk<Args...> called with entry.object by McEmitBatch(), if the subscriber takes batches
+		McSubscriberRoute route = {}; //the key of a keyed subscriber, empty for the others
+		size_t salt = 0; //tells apart the connections of one callback with different keys or filters
+		McRouteKey route_key = {}; //the key itself, for the keys that get the same salt
+
+		static inline McSubscriber direct(const McFunctionId& callback) {
+			auto owner = McMakeShared<const McFunctionId>(callback);
+			return McSubscriber{ owner->entry(), std::move(owner) };
+		}
+	};
+
+	enum class McConnectionType {
+		Direct, //the subscriber is called by McEmit() on the emitting thread
+		Queued, //McEmit() puts the call into the mailbox of the reciever, the reciever calls ProcessEvents() on its own thread
+		Latest  //as Queued, but only the latest arguments are kept: ProcessEvents() calls the subscriber once however many events were emitted
+	};
+
+	enum class McOverflowPolicy {
+		Block,      //the emitter waits until the reciever frees a place. The event is dropped if no one will: the mailbox is closed, or the emitting thread is the one that processes it
+		DropNewest, //the event being emitted is lost
+		DropOldest  //the oldest pending event is lost
+	};
+
+	/// <summary>
+	/// Told by a mailbox about every posted event, so an event loop can wake up to process it (see multicall_dispatcher.h).
+	/// Called on the emitting thread, it should coalesce the wakeups: one per batch of events is enough.
+	/// </summary>
+	struct McMailboxNotifier {
+		virtual ~McMailboxNotifier() = default;
+		virtual void notify() noexcept = 0;
+	};
+
+	/// <summary>
+	/// Bounded lock-free queue of the calls to a reciever (Dmitry Vyukov's bounded MPMC queue).
+	/// Any thread may post, one thread at a time processes. Producers with DropOldest policy dequeue too, that's why it isn't SPSC-simplified.
+	/// </summary>
+	class McMailbox {
+	public:
+		McMailbox(size_t capacity, McOverflowPolicy policy, std::shared_ptr<McMailboxNotifier> notifier = nullptr) : m_policy(policy), m_notifier(std::move(notifier)) {
+			size_t real_capacity = 2;
+			while (real_capacity < capacity) {
+				real_capacity <<= 1;
+			}
+			m_mask = real_capacity - 1;
+			m_cells.reset(new Cell[real_capacity]);
+			for (size_t i = 0; i < real_capacity; ++i) {
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
 			}
+		}
+		~McMailbox() {
+			while (dequeue(false));
+		}
+		McMailbox(const McMailbox&) = delete;
+		McMailbox& operator = (const McMailbox&) = delete;
+
+		inline size_t capacity() const noexcept { return m_mask + 1; }
+		inline McOverflowPolicy policy() const noexcept { return m_policy; }
+
+		//Queues a call of function(). Returns false if the event was dropped.
+		template<class F>
+		bool post(F&& function) noexcept {
+			for (;;) {
+				Cell* cell = acquireForWrite();
+				if (cell) {
+					using Call = QueuedCall<std::decay_t<F>>;
+					if constexpr (sizeof(Call) <= sizeof(cell->buffer)) {
+						cell->call = new(cell->buffer) Call(std::forward<F>(function));
+						cell->on_heap = false;
+					}else {
+						cell->call = new Call(std::forward<F>(function));
+						cell->on_heap = true;
+					}
+					cell->sequence.store(cell->position + 1, std::memory_order_release);
+					if (m_notifier) {
+						m_notifier->notify();
+					}
+					return true;
+				}
+				switch (m_policy) {
+					case McOverflowPolicy::Block:
+						if (isClosed() || m_consumer.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+							return false; //would wait forever: the reciever is gone, or it is this thread
+						}
+						std::this_thread::yield();
+						break;
+					case McOverflowPolicy::DropNewest:
+						return false;
+					case McOverflowPolicy::DropOldest:
+						dequeue(false);
+						break;
+				}
+			}
+		}
+
+		//Calls the pending events in the order they were posted. Must be called from one thread at a time.
+		inline size_t processEvents(size_t max_count = SIZE_MAX) noexcept {
+			if (m_consumer.load(std::memory_order_relaxed) != std::this_thread::get_id()) {
+				m_consumer.store(std::this_thread::get_id(), std::memory_order_relaxed);
+			}
+			size_t count = 0;
+			const bool call = !isClosed();
+			while (count < max_count && dequeue(call)) {
+				++count;
+			}
+			return count;
+		}
+
+		//The reciever is gone: the events still posted by running emits are dropped instead of called
+		inline void close() noexcept { m_closed.store(true, std::memory_order_release); }
+		inline bool isClosed() const noexcept { return m_closed.load(std::memory_order_acquire); }
+
+	private:
+		struct QueuedCallBase : McPoolAllocated {
+			virtual ~QueuedCallBase() = default;
+			virtual void call() noexcept = 0;
+		};
+
+		template<class F>
+		struct QueuedCall : QueuedCallBase {
+			template<class Function>
+			QueuedCall(Function&& function) : m_function(std::forward<Function>(function)) {}
+
+			void call() noexcept override {
+				m_function();
+			}
+
+			F m_function;
+		};
+
+		struct Cell {
+			std::atomic<size_t> sequence{ 0 };
+			size_t position = 0;
+			QueuedCallBase* call = nullptr;
+			bool on_heap = false;
+			alignas(std::max_align_t) uint8_t buffer[sizeof(size_t) * 8]; //enough for the callback and a couple of arguments
+		};
+
+		inline Cell* acquireForWrite() noexcept {
+			size_t position = m_enqueue_position.load(std::memory_order_relaxed);
+			for (;;) {
+				Cell* cell = &m_cells[position & m_mask];
+				const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				const intptr_t diff = intptr_t(sequence) - intptr_t(position);
+				if (diff == 0) {
+					if (m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						cell->position = position;
+						return cell;
+					}
+				}else if (diff < 0) {
+					return nullptr; //full
+				}else {
+					position = m_enqueue_position.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		inline bool dequeue(bool call) noexcept {
+			size_t position = m_dequeue_position.load(std::memory_order_relaxed);
+			Cell* cell = nullptr;
+			for (;;) {
+				cell = &m_cells[position & m_mask];
+				const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				const intptr_t diff = intptr_t(sequence) - intptr_t(position + 1);
+				if (diff == 0) {
+					if (m_dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				}else if (diff < 0) {
+					return false; //empty
+				}else {
+					position = m_dequeue_position.load(std::memory_order_relaxed);
+				}
+			}
+			if (call) {
+				cell->call->call();
+			}
+			if (cell->on_heap) {
+				delete cell->call;
+			}else {
+				cell->call->~QueuedCallBase(); //placement new was used
+			}
+			cell->call = nullptr;
+			cell->sequence.store(position + m_mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		const McOverflowPolicy m_policy;
+		const std::shared_ptr<McMailboxNotifier> m_notifier;
+		std::atomic<bool> m_closed{ false };
+		std::atomic<std::thread::id> m_consumer{ std::this_thread::get_id() }; //of the last processEvents(), at first the thread that made the mailbox. Block doesn't wait for itself
+		size_t m_mask = 0;
+		std::unique_ptr<Cell[]> m_cells;
+		alignas(64) std::atomic<size_t> m_enqueue_position{ 0 };
+		alignas(64) std::atomic<size_t> m_dequeue_position{ 0 };
+	};
+
+	/// <summary>
+	/// What a queued connection puts into the subscribers list: posts the call to the mailbox of the reciever instead of calling it.
+	/// </summary>
+	struct McQueuedSubscriber {
+		std::shared_ptr<const McFunctionId> callback;
+		std::shared_ptr<McMailbox> mailbox; //shared, so an emit that is still running after the reciever is gone posts into an orphan mailbox
+
+		template<class ...Args>
+		static inline McSubscriber make(const McFunctionId& callback, std::shared_ptr<McMailbox> mailbox) {
+			static_assert(McCopyableArgs<Args...>::value, "A queued connection needs copyable arguments");
+			auto owner = McMakeShared<const McQueuedSubscriber>(McQueuedSubscriber{ McMakeShared<const McFunctionId>(callback), std::move(mailbox) });
+			McSubscriberEntry entry{ owner.get(), reinterpret_cast<McSubscriberEntry::ErasedThunk>(static_cast<McSubscriberEntry::Thunk<Args...>>(&McQueuedSubscriber::post<Args...>)) };
+			return McSubscriber{ entry, std::move(owner) };
+		}
+
+		template<class ...Args>
+		static void post(const void* obj, const McEmitArgs<Args...>& args) noexcept {
+			const McQueuedSubscriber* subscriber = static_cast<const McQueuedSubscriber*>(obj);
+			subscriber->mailbox->post([callback = subscriber->callback, values = args.shared()]() {
+				callback->call(McEmitArgs<Args...>(values));
+			});
+		}
+	};
+
+	/// <summary>
+	/// Keeps only the latest arguments of a signal. Thread safe.
+	/// </summary>
+	template<class ...Args>
+	struct McLatestCell {
+		using Value = std::tuple<std::decay_t<Args>...>;
+
+		//Returns true if the previous value has been taken already (or there was no value)
+		inline bool store(const std::shared_ptr<const Value>& value) {
+			std::lock_guard locker(m_mutex);
+			m_value = value;
+			const bool was_updated = m_updated;
+			m_updated = true;
+			return !was_updated;
+		}
+
+		//Gives the value if it has been changed since the previous take()
+		inline bool take(std::shared_ptr<const Value>& value) {
+			std::lock_guard locker(m_mutex);
+			if (!m_updated) {
+				return false;
+			}
+			value = m_value;
+			m_updated = false;
+			return true;
+		}
+
+		inline bool take(Value& value) {
+			std::shared_ptr<const Value> latest;
+			if (!take(latest)) {
+				return false;
+			}
+			value = *latest;
+			return true;
+		}
+
+		inline bool get(Value& value) const {
+			std::lock_guard locker(m_mutex);
+			if (!m_value) {
+				return false;
+			}
+			value = *m_value;
+			return true;
+		}
+
+		inline void resetUpdated() {
+			std::lock_guard locker(m_mutex);
+			m_updated = false;
+		}
+
+		static void storeThunk(const void* obj, const McEmitArgs<Args...>& args) noexcept {
+			static_cast<McLatestCell*>(const_cast<void*>(obj))->store(args.shared());
+		}
+
+	private:
+		mutable std::mutex m_mutex;
+		std::shared_ptr<const Value> m_value; //the shared pack of the emit, so storing doesn't copy the arguments
+		bool m_updated = false;
+	};
+
+	/// <summary>
+	/// Latest value of a signal that the reciever reads when it wants to. Connect() it to a signal instead of a callback: 
+	/// McEmit() only overwrites the value, nothing is called.
+	/// </summary>
+	template<class ...Args>
+	class McLatest {
+	public:
+		using Value = typename McLatestCell<Args...>::Value;
+
+		McLatest() : m_cell(McMakeShared<McLatestCell<Args...>>()) {}
+
+		//Copies the latest value if it has been changed since the previous take()
+		inline bool take(Value& value) { return m_cell->take(value); }
+		//Copies the latest value. Returns false if nothing has been emitted yet.
+		inline bool get(Value& value) const { return m_cell->get(value); }
+
+		//Identifies the connection, use it to Disconnect()
+		inline McFunctionId id() const noexcept { return McFunctionId(ArgsPlaceholder<Args...>{}, Identity{ m_cell.get() }); }
+
+		inline McSubscriber subscriber() const {
+			static_assert(McCopyableArgs<Args...>::value, "McLatest needs copyable arguments");
+			McSubscriberEntry entry{ m_cell.get(), reinterpret_cast<McSubscriberEntry::ErasedThunk>(static_cast<McSubscriberEntry::Thunk<Args...>>(&McLatestCell<Args...>::storeThunk)) };
+			return McSubscriber{ entry, McMakeShared<std::shared_ptr<McLatestCell<Args...>>>(m_cell) }; //an owner of its own, so only snapshots hold it
+		}
+
+	private:
+		struct Identity {
+			McLatestCell<Args...>* cell;
+			template<class ...Values>
+			inline void operator()(Values&& ...) const noexcept {} //never called, the subscriber() is
+		};
+
+		std::shared_ptr<McLatestCell<Args...>> m_cell; //shared with the subscribers list, so the object may be destroyed before the sender
+	};
+
+	/// <summary>
+	/// What a McConnectionType::Latest connection puts into the subscribers list. McEmit() overwrites the latest value and posts 
+	/// a delivery to the mailbox only if there isn't one pending already, so superseded events cost neither a call nor a queued event.
+	/// </summary>
+	template<class ...Args>
+	struct McLatestSubscriber {
+		std::shared_ptr<const McFunctionId> callback;
+		std::shared_ptr<McMailbox> mailbox;
+		std::shared_ptr<McLatestCell<Args...>> cell;
+
+		static inline McSubscriber make(const McFunctionId& callback, std::shared_ptr<McMailbox> mailbox) {
+			static_assert(McCopyableArgs<Args...>::value, "A latest connection needs copyable arguments");
+			auto owner = McMakeShared<const McLatestSubscriber>(McLatestSubscriber{ McMakeShared<const McFunctionId>(callback), std::move(mailbox), McMakeShared<McLatestCell<Args...>>() });
+			McSubscriberEntry entry{ owner.get(), reinterpret_cast<McSubscriberEntry::ErasedThunk>(static_cast<McSubscriberEntry::Thunk<Args...>>(&McLatestSubscriber::post)) };
+			return McSubscriber{ entry, std::move(owner) };
+		}
+
+		static void post(const void* obj, const McEmitArgs<Args...>& args) noexcept {
+			const McLatestSubscriber* subscriber = static_cast<const McLatestSubscriber*>(obj);
+			if (subscriber->cell->store(args.shared())) {
+				const bool posted = subscriber->mailbox->post([callback = subscriber->callback, cell = subscriber->cell]() {
+					std::shared_ptr<const typename McLatestCell<Args...>::Value> value;
+					if (cell->take(value)) {
+						callback->call(McEmitArgs<Args...>(std::move(value)));
+					}
+				});
+				if (!posted) {
+					subscriber->cell->resetUpdated(); //the next emit will try again
+				}
+			}
+		}
+	};
+
+	/// <summary>
+	/// Limits the rate of calls of a subscriber. Zero means no limit.
+	/// </summary>
+	struct McThrottle {
+		double max_calls_per_second = 0;
+	};
+
+	/// <summary>
+	/// Wraps another subscriber and drops the events that come sooner than the interval after the previous delivered one.
+	/// The check is done before anything else, so a dropped event costs only a clock read.
+	/// </summary>
+	template<class ...Args>
+	struct McThrottledSubscriber {
+		McSubscriber subscriber;
+		int64_t interval_ns;
+		mutable std::atomic<int64_t> next_call_ns{ 0 };
+
+		McThrottledSubscriber(McSubscriber subscriber_, int64_t interval) : subscriber(std::move(subscriber_)), interval_ns(interval) {}
+
+		static inline McSubscriber make(McSubscriber subscriber, McThrottle throttle) {
+			const int64_t interval = int64_t(1e9 / throttle.max_calls_per_second);
+			auto owner = McMakeShared<const McThrottledSubscriber>(std::move(subscriber), interval);
+			McSubscriberEntry entry{ owner.get(), reinterpret_cast<McSubscriberEntry::ErasedThunk>(static_cast<McSubscriberEntry::Thunk<Args...>>(&McThrottledSubscriber::call)) };
+			return McSubscriber{ entry, std::move(owner) };
+		}
+
+		static void call(const void* obj, const McEmitArgs<Args...>& args) noexcept {
+			const McThrottledSubscriber* throttled = static_cast<const McThrottledSubscriber*>(obj);
+			const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			int64_t next_call = throttled->next_call_ns.load(std::memory_order_relaxed);
+			if (now < next_call || !throttled->next_call_ns.compare_exchange_strong(next_call, now + throttled->interval_ns, std::memory_order_relaxed)) {
+				return;
+			}
+			throttled->subscriber.entry.call(args);
+		}
+	};
+
+	/// <summary>
+	/// The key of a signal is its first argument, unless McKey is given an extractor
+	/// </summary>
+	struct McFirstArgument {};
+
+	/// <summary>
+	/// Connects a subscriber for one key only: it is called for the emits whose key equals value. The key is the first argument,
+	/// or what the extractor (a function or a lambda without captures) returns for the arguments.
+	/// The sender finds the subscribers of a key in a hash index, so the subscribers of the other keys cost nothing at emit.
+	/// </summary>
+	template<class K, class Extractor = McFirstArgument>
+	struct McKey {
+		K value;
+		Extractor extractor;
+
+		McKey(K value_, Extractor extractor_ = {}) : value(std::move(value_)), extractor(extractor_) {}
+	};
+
+	template<class K, class F>
+	McKey(K, F) -> McKey<K, decltype(+std::declval<F>())>;
+
+	/// <summary>
+	/// Connects a subscriber for the emits that predicate(arguments...) accepts, e.g. a range of keys.
+	/// The sender checks it first, so a rejected emit costs the predicate call, not a call (or a queued event) of the subscriber.
+	/// </summary>
+	template<class P>
+	struct McFilter {
+		P predicate;
+
+		McFilter(P predicate_) : predicate(std::move(predicate_)) {}
+	};
+
+	/// <summary>
+	/// Wraps another subscriber with its key. McEmit() calls it through the route only for the emits with the same key hash,
+	/// the key itself is compared here, so hash collisions and the emits that don't route (McEmitBatch...) are filtered too.
+	/// </summary>
+	template<class K, class Extractor, class ...Args>
+	struct McKeyedSubscriber {
+		McSubscriber subscriber;
+		McKey<K, Extractor> key;
+
+		static_assert(std::is_same_v<Extractor, McFirstArgument> || std::is_function_v<std::remove_pointer_t<Extractor>>, "The key extractor must be a function or a lambda without captures");
+
+		static inline McSubscriber make(McSubscriber subscriber, McKey<K, Extractor> key) {
+			const size_t hash = std::hash<K>{}(key.value);
+			McSubscriberEntry::ErasedThunk extractor = nullptr;
+			if constexpr (!std::is_same_v<Extractor, McFirstArgument>) {
+				extractor = reinterpret_cast<McSubscriberEntry::ErasedThunk>(key.extractor);
+			}
+			auto owner = McMakeShared<const McKeyedSubscriber>(McKeyedSubscriber{ std::move(subscriber), std::move(key) });
+			McSubscriberEntry entry{ owner.get(), reinterpret_cast<McSubscriberEntry::ErasedThunk>(static_cast<McSubscriberEntry::Thunk<Args...>>(&McKeyedSubscriber::call)) };
+			McSubscriberRoute route{ reinterpret_cast<McSubscriberEntry::ErasedThunk>(static_cast<McSubscriberRoute::HashThunk<Args...>>(&McKeyedSubscriber::hashOf)), extractor, hash };
+			const size_t salt = hash ^ reinterpret_cast<size_t>(route.hash_thunk) ^ reinterpret_cast<size_t>(extractor);
+			McRouteKey route_key{ McMakeShared<const RouteKey>(RouteKey{ owner->key.value, extractor }), &McKeyedSubscriber::sameKey };
+			return McSubscriber{ entry, std::move(owner), nullptr, route, salt ? salt : 1, std::move(route_key) };
+		}
+
+		//What McRouteKey compares: the key and the extractor (McFirstArgument ones are all the same)
+		struct RouteKey {
+			K value;
+			McSubscriberEntry::ErasedThunk extractor;
+		};
+		static bool sameKey(const void* left, const void* right) noexcept {
+			const RouteKey& left_key = *static_cast<const RouteKey*>(left);
+			const RouteKey& right_key = *static_cast<const RouteKey*>(right);
+			return left_key.extractor == right_key.extractor && left_key.value == right_key.value;
+		}
+
+		static inline decltype(auto) keyOf(Extractor extractor, const McEmitArgs<Args...>& args) {
+			if constexpr (std::is_same_v<Extractor, McFirstArgument>) {
+				return args.template get<0>();
+			}else {
+				return args.inspect(extractor);
+			}
+		}
+
+		static size_t hashOf(McSubscriberEntry::ErasedThunk extractor, const McEmitArgs<Args...>& args) noexcept {
+			if constexpr (std::is_same_v<Extractor, McFirstArgument>) {
+				return std::hash<K>{}(keyOf({}, args));
+			}else {
+				return std::hash<K>{}(keyOf(reinterpret_cast<Extractor>(extractor), args));
+			}
+		}
+
+		static void call(const void* obj, const McEmitArgs<Args...>& args) noexcept {
+			const McKeyedSubscriber* keyed = static_cast<const McKeyedSubscriber*>(obj);
+			if (keyOf(keyed->key.extractor, args) == keyed->key.value) {
+				keyed->subscriber.entry.call(args);
+			}
+		}
+	};
+
+	/// <summary>
+	/// Wraps another subscriber with its filter
+	/// </summary>
+	template<class P, class ...Args>
+	struct McFilteredSubscriber {
+		McSubscriber subscriber;
+		P predicate;
+
+		static inline McSubscriber make(McSubscriber subscriber, McFilter<P> filter) {
+			auto owner = McMakeShared<const McFilteredSubscriber>(McFilteredSubscriber{ std::move(subscriber), std::move(filter.predicate) });
+			McSubscriberEntry entry{ owner.get(), reinterpret_cast<McSubscriberEntry::ErasedThunk>(static_cast<McSubscriberEntry::Thunk<Args...>>(&McFilteredSubscriber::call)) };
+			const size_t salt = reinterpret_cast<size_t>(owner.get()); //filters can't be compared, every filtered connection is a new one
+			return McSubscriber{ entry, std::move(owner), nullptr, {}, salt };
+		}
+
+		static void call(const void* obj, const McEmitArgs<Args...>& args) noexcept {
+			const McFilteredSubscriber* filtered = static_cast<const McFilteredSubscriber*>(obj);
+			if (args.inspect(filtered->predicate)) {
+				filtered->subscriber.entry.call(args);
+			}
+		}
+	};
+
+	/// <summary>
+	/// What a connection of a batch-aware callback puts into the subscribers list. A single event becomes a batch of one.
+	/// </summary>
+	struct McBatchSubscriber {
+		std::shared_ptr<const McFunctionId> callback; //takes McBatch<Args...>
+
+		template<class ...Args>
+		static inline McSubscriber make(const McFunctionId& callback) {
+			static_assert(McCopyableArgs<Args...>::value, "A batch connection needs copyable arguments");
+			auto owner = McMakeShared<const McBatchSubscriber>(McBatchSubscriber{ McMakeShared<const McFunctionId>(callback) });
+			McSubscriberEntry entry{ owner.get(), reinterpret_cast<McSubscriberEntry::ErasedThunk>(static_cast<McSubscriberEntry::Thunk<Args...>>(&McBatchSubscriber::single<Args...>)) };
+			auto batch_thunk = reinterpret_cast<McSubscriberEntry::ErasedThunk>(static_cast<McSubscriber::BatchThunk<Args...>>(&McBatchSubscriber::batch<Args...>));
+			return McSubscriber{ entry, std::move(owner), batch_thunk };
+		}
+
+		template<class ...Args>
+		static void single(const void* obj, const McEmitArgs<Args...>& args) noexcept {
+			batch<Args...>(obj, McBatch<Args...>(args.shared().get(), 1));
+		}
+
+		template<class ...Args>
+		static void batch(const void* obj, McBatch<Args...> events) noexcept {
+			static_cast<const McBatchSubscriber*>(obj)->callback->call(McEmitArgs<McBatch<Args...>>(events));
+		}
+	};
+
+	/// <summary>
+	/// Work-stealing thread pool for McEmitParallel(). Every worker has its own deque: it takes the newest task from its own deque
+	/// and steals the oldest ones from the others when it runs out of work.
+	/// </summary>
+	class McThreadPool {
+	public:
+		explicit McThreadPool(size_t threads = std::thread::hardware_concurrency()) {
+			threads = threads ? threads : 1;
+			for (size_t i = 0; i < threads; ++i) {
+				m_queues.emplace_back(std::make_unique<Queue>());
+			}
+			for (size_t i = 0; i < threads; ++i) {
+				m_threads.emplace_back(&McThreadPool::workerThread, this, i);
+			}
+		}
+		//Runs the tasks that are already submitted and stops the workers
+		~McThreadPool() {
+			{
+				std::lock_guard locker(m_sleep_mutex);
+				m_stop = true;
+			}
+			m_wakeup.notify_all();
+			for (auto& thread : m_threads) {
+				thread.join();
+			}
+		}
+		McThreadPool(const McThreadPool&) = delete;
+		McThreadPool& operator = (const McThreadPool&) = delete;
+
+		inline size_t size() const noexcept { return m_threads.size(); }
+
+		inline void submit(std::function<void()> task) {
+			const size_t queue_index = t_worker_pool == this ? t_worker_index : m_next_queue++ % m_queues.size();
+			{
+				std::lock_guard locker(m_queues[queue_index]->mutex);
+				m_queues[queue_index]->tasks.push_back(std::move(task));
+			}
+			++m_pending;
+			{
+				std::lock_guard locker(m_sleep_mutex); //a worker can't miss the notification between its check and its wait
+			}
+			m_wakeup.notify_one();
+		}
+
+		//Runs one pending task on the calling thread. Returns false if there was nothing to run.
+		inline bool runOne() {
+			std::function<void()> task;
+			if (steal(t_worker_pool == this ? t_worker_index : 0, task)) {
+				task();
+				return true;
+			}
+			return false;
+		}
+
+	private:
+		struct Queue {
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		std::vector<std::unique_ptr<Queue>> m_queues;
+		std::vector<std::thread> m_threads;
+		std::atomic<size_t> m_next_queue{ 0 };
+		std::atomic<size_t> m_pending{ 0 }; //submitted but not taken yet
+		std::mutex m_sleep_mutex;
+		std::condition_variable m_wakeup;
+		bool m_stop = false;
+
+		static inline thread_local McThreadPool* t_worker_pool = nullptr;
+		static inline thread_local size_t t_worker_index = 0;
+
+		inline bool popOwn(size_t index, std::function<void()>& task) {
+			Queue& queue = *m_queues[index];
+			std::lock_guard locker(queue.mutex);
+			if (queue.tasks.empty()) {
+				return false;
+			}
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			--m_pending;
+			return true;
+		}
+
+		inline bool steal(size_t first, std::function<void()>& task) {
+			for (size_t i = 0; i < m_queues.size(); ++i) {
+				Queue& queue = *m_queues[(first + i) % m_queues.size()];
+				std::lock_guard locker(queue.mutex);
+				if (!queue.tasks.empty()) {
+					task = std::move(queue.tasks.front());
+					queue.tasks.pop_front();
+					--m_pending;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void workerThread(size_t index) {
+			t_worker_pool = this;
+			t_worker_index = index;
+			std::function<void()> task;
+			for (;;) {
+				if (popOwn(index, task) || steal(index + 1, task)) {
+					task();
+					task = nullptr;
+					continue;
+				}
+				std::unique_lock locker(m_sleep_mutex);
+				m_wakeup.wait(locker, [this]() { return m_stop || m_pending > 0; });
+				if (m_stop && m_pending == 0) {
+					return;
+				}
+			}
+		}
+	};
+
+	enum class McDisconnectMode {
+		Async, //returns at once, the emits that are already running may still call the subscriber
+		Wait   //returns when no running emit may call the subscriber anymore. Emits of the calling thread (Disconnect() from a subscriber) aren't waited for.
+	};
+
+	/// <summary>
+	/// Move-only handle of one connection, returned by Connect(). It records the slot of the subscriber in the sender,
+	/// so disconnect() goes straight to it instead of rebuilding and rehashing the callback.
+	/// Like a plain Connect(), it leaves the connection alone when destroyed: keep it in McScopedConnection for that.
+	/// </summary>
+	class McConnection {
+	public:
+		McConnection() = default;
+		McConnection(McConnection&&) noexcept = default;
+		McConnection& operator = (McConnection&&) noexcept = default;
+		McConnection(const McConnection&) = delete;
+		McConnection& operator = (const McConnection&) = delete;
+
+		//False if Connect() failed, after disconnect() and after either side has disconnected everything
+		inline bool connected() const noexcept { return !m_slot.expired(); }
+		inline explicit operator bool() const noexcept { return connected(); }
+		//The callback, for Disconnect(signal, id)
+		inline const McFunctionId& id() const noexcept { return m_key.id; }
+
+		//Returns false if there was nothing to disconnect
+		inline bool disconnect(McDisconnectMode mode = McDisconnectMode::Async);
+
+	private:
+		friend MultiCallBase;
+
+		McSignalId m_signal;
+		McSubscriberKey m_key;
+		MultiCallBase* m_reciever = nullptr; //has the connection in its senders bookkeeping, null for free callbacks
+		std::weak_ptr<const void> m_slot; //owner of the subscriber, expires when no snapshot of the sender holds it anymore
+	};
+
+	/// <summary>
+	/// Disconnects the connection when destroyed or reassigned. Put it into the reciever to tie the connection to its lifetime.
+	/// </summary>
+	class McScopedConnection {
+	public:
+		McScopedConnection() = default;
+		inline McScopedConnection(McConnection connection) noexcept : m_connection(std::move(connection)) {}
+		inline ~McScopedConnection() { m_connection.disconnect(); }
+		McScopedConnection(McScopedConnection&&) noexcept = default;
+		inline McScopedConnection& operator = (McScopedConnection&& other) noexcept {
+			if (&other != this) {
+				m_connection.disconnect();
+				m_connection = std::move(other.m_connection);
+			}
+			return *this;
+		}
+
+		inline bool connected() const noexcept { return m_connection.connected(); }
+		inline explicit operator bool() const noexcept { return connected(); }
+		inline const McFunctionId& id() const noexcept { return m_connection.id(); }
+		inline bool disconnect(McDisconnectMode mode = McDisconnectMode::Async) { return m_connection.disconnect(mode); }
+		//Keeps the connection, this handle forgets it
+		inline McConnection release() noexcept { return std::move(m_connection); }
+
+	private:
+		McConnection m_connection;
+	};
+
+	enum class McParallelMode {
+		Wait,  //McEmitParallel() returns when all the subscribers are called. The emitting thread takes part in the work.
+		Detach //McEmitParallel() returns right after the work is submitted
+	};
+
+	/// <summary>
+	/// Connections of one object, as MultiCallBase::ConnectionGraph() sees them at the moment of the call.
+	/// The statistics are zero unless MC_ENABLE_METRICS is 1.
+	/// </summary>
+	struct McConnectionGraph {
+		struct Subscriber {
+			MultiCallBase* reciever; //nullptr for free functions, lambdas and McLatest
+			McDispatchStats dispatch;
+		};
+		//A signal of this object with at least one subscriber
+		struct Signal {
+			const char* interface_tag; //&McInterfaceTag<Interface>::id
+			size_t index; //McSignalSlot index within the interface
+			uint64_t emits;
+			std::vector<Subscriber> subscribers; //in the order McEmit() calls them
+			McLockStats lock; //of this signal
+		};
+		//A signal of another object this object is connected to
+		struct Source {
+			MultiCallBase* sender;
+			const char* interface_tag;
+			size_t index;
+		};
+
+		const MultiCallBase* object;
+		std::vector<Signal> signals;
+		std::vector<Source> sources;
+		McLockStats lock; //of the signals table and of the reciever bookkeeping
+	};
+
+	class MultiCallBase
+	{
+		//Keys of the connections of this object as a reciever to one signal
+		using __SendersStorage = std::unordered_set<McSubscriberKey, McSubscriberKeyHash, std::equal_to<McSubscriberKey>, McAllocator<McSubscriberKey>>;
+		using __SendersMap = std::unordered_map<McSignalId, __SendersStorage, McSignalIdHash, std::equal_to<McSignalId>, McAllocator<std::pair<const McSignalId, __SendersStorage>>>;
+		//The subscribers of one signal as the emits see them, published as a whole
+		struct __RecieversStorage;
+		using __RecieversSnapshot = std::shared_ptr<const __RecieversStorage>;
+
+	public:
+		virtual ~MultiCallBase() {
+			const std::unique_ptr<__ConnectionState> state(__m_state.load(std::memory_order_acquire));
+			if (!state) {
+				return; //never connected
+			}
+			DisconnectFromAll();
+			if (state->mailbox) {
+				state->mailbox->close();
+			}
+		};
+
+		//Call it with McDisconnectMode::Wait from the destructor of the reciever itself: when the destructor of MultiCallBase runs, the reciever is gone already.
+		//The bookkeeping is taken out under the locks and released before the other objects are visited, so no two objects are locked at once.
+		//Every sender signal and every reciever is visited once, whatever the number of connections to it.
+		inline void DisconnectFromAll(McDisconnectMode mode = McDisconnectMode::Async) {
+			__ConnectionState* state = existingState();
+			if (!state) {
+				return;
+			}
+			std::unique_lock senders_locker(state->senders_mutex);
+			__SendersMap senders = std::move(state->senders_map);
+			state->senders_map.clear();
+			senders_locker.unlock();
+			std::vector<std::pair<McSignalId, __RecieversList>> recievers;
+			if (const __SignalTable* table = state->signal_table.load(std::memory_order_acquire)) {
+				for (const auto& interface_recievers : table->interfaces) {
+					for (size_t index = 0; index < interface_recievers.signals.size(); ++index) {
+						__SignalRecievers* signal = interface_recievers.signals[index];
+						if (signal) {
+							std::unique_lock locker(signal->mutex);
+							if (!signal->list.index.empty()) {
+								recievers.emplace_back(McSignalId{ this, interface_recievers.interface_tag, index }, std::move(signal->list));
+								signal->list = __RecieversList();
+							}
+						}
+					}
+				}
+			}
+			std::vector<__RecieversSnapshot> waited;
+			std::vector<__RecieversSnapshot>* waited_snapshots = mode == McDisconnectMode::Wait ? &waited : nullptr;
+			for (const auto& [sender_id, keys] : senders) {
+				sender_id.sender->removeSubscribers(sender_id, keys, waited_snapshots);
+			}
+			std::unordered_map<MultiCallBase*, __SendersStorage> by_reciever;
+			for (const auto& [sender_id, subscribers] : recievers) {
+				for (const auto& [reciever, reciever_owner] : subscribers.index) {
+					MultiCallBase* reciever_obj = reciever.id.getObject();
+					if (reciever_obj) {
+						by_reciever[reciever_obj].insert(reciever);
+					}
+				}
+				for (const auto& [reciever_obj, keys] : by_reciever) {
+					reciever_obj->removeSenders(sender_id, keys);
+				}
+				by_reciever.clear();
+				if (waited_snapshots) {
+					runningSnapshots(subscribers, [](const __RecieversStorage&) { return true; }, waited);
+				}
+			}
+			recievers.clear();
+			waitForEmits(waited);
+		}
+
+		template<class _Reciever, class ..._Signature>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(_Signature...), 
+			McConnectionType type = McConnectionType::Direct, McThrottle throttle = {}) {
+			return connectMember(sender_id, reciever, callback, type, throttle);
+		}
+
+		//The callback may take const T& (or T&&, for T&& arguments) instead of T to avoid copying the arguments
+		template<class _Reciever, class ..._Signature, class ..._Params>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(_Params...), 
+			McConnectionType type = McConnectionType::Direct, McThrottle throttle = {}) {
+			static_assert(McParamsAccept<std::tuple<_Signature...>, std::tuple<_Params...>>::value, "The callback parameters don't match the signal");
+			return connectMember(sender_id, reciever, callback, type, throttle);
+		}
+
+		//Connects a callback that takes the whole burst of McEmitBatch() at once. Single events come as batches of one.
+		template<class _Reciever, class ..._Signature>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(McBatch<_Signature...>)) {
+			const McSignalId signal_id = sender_id.id();
+			if (!signal_id.sender) {
+				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
+				return McConnection();
+			}
+			McFunctionId reciever_id(reciever, callback);
+			MultiCallBase* reciever_object = reciever_id.getObject();
+			if (!reciever_object) {
+				//std::cerr << "Reciever doesn't inherits to MultiCallBase!\n";
+				return McConnection();
+			}
+			return connect(signal_id, reciever_object, reciever_id, McBatchSubscriber::make<_Signature...>(reciever_id));
+		}
+
+		template<class ..._Signature>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, void(*callback)(_Signature...), McThrottle throttle = {}) {
+			return connectFunction(sender_id, callback, throttle);
+		}
+
+		template<class ..._Signature, class ..._Params>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, void(*callback)(_Params...), McThrottle throttle = {}) {
+			static_assert(McParamsAccept<std::tuple<_Signature...>, std::tuple<_Params...>>::value, "The callback parameters don't match the signal");
+			return connectFunction(sender_id, callback, throttle);
+		}
+
+		template<class ..._Signature, class F>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, F callback, McThrottle throttle = {}) {
+			static_assert(std::is_convertible_v<F, std::function<void(_Signature...)>>, "F must be convertible to std::function");
+			const McSignalId signal_id = sender_id.id();
+			if (!signal_id.sender) {
+				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
+				return McConnection();
+			}
+			McFunctionId reciever_id(ArgsPlaceholder<_Signature...>{}, callback);
+			return connect(signal_id, nullptr, reciever_id, throttled<_Signature...>(McSubscriber::direct(reciever_id), throttle));
+		}
+
+		//Keyed and filtered connections, see McKey and McFilter. The same callback may be connected for several keys,
+		//so they can't be found by the callback: disconnect them with the returned McConnection (or DisconnectFromAll()).
+		template<class _Reciever, class ..._Signature, class ..._Params, class K, class E>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(_Params...), McKey<K, E> key,
+			McConnectionType type = McConnectionType::Direct, McThrottle throttle = {}) {
+			static_assert(McParamsAccept<std::tuple<_Signature...>, std::tuple<_Params...>>::value, "The callback parameters don't match the signal");
+			return connectMember(sender_id, reciever, callback, type, throttle, std::move(key));
+		}
+
+		template<class _Reciever, class ..._Signature, class ..._Params, class P>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(_Params...), McFilter<P> filter,
+			McConnectionType type = McConnectionType::Direct, McThrottle throttle = {}) {
+			static_assert(McParamsAccept<std::tuple<_Signature...>, std::tuple<_Params...>>::value, "The callback parameters don't match the signal");
+			return connectMember(sender_id, reciever, callback, type, throttle, std::move(filter));
+		}
+
+		template<class ..._Signature, class F, class K, class E>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, F callback, McKey<K, E> key, McThrottle throttle = {}) {
+			static_assert(std::is_convertible_v<F, std::function<void(_Signature...)>>, "F must be convertible to std::function");
+			return connectFunction(sender_id, callback, throttle, std::move(key));
+		}
+
+		template<class ..._Signature, class F, class P>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, F callback, McFilter<P> filter, McThrottle throttle = {}) {
+			static_assert(std::is_convertible_v<F, std::function<void(_Signature...)>>, "F must be convertible to std::function");
+			return connectFunction(sender_id, callback, throttle, std::move(filter));
+		}
+
+		//The signal only overwrites the value of latest. Use latest.id() to Disconnect().
+		template<class ..._Signature>
+		static inline McConnection Connect(const McSignal<_Signature...>& sender_id, const McLatest<_Signature...>& latest) {
+			const McSignalId signal_id = sender_id.id();
+			if (!signal_id.sender) {
+				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
+				return McConnection();
+			}
+			return connect(signal_id, nullptr, latest.id(), latest.subscriber());
+		}
+
+		template<class _Reciever, class ..._Signature>
+		static inline bool Disconnect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(_Signature...),
+			McDisconnectMode mode = McDisconnectMode::Async) {
+			return disconnectMember(sender_id, reciever, callback, mode);
+		}
+
+		template<class _Reciever, class ..._Signature, class ..._Params>
+		static inline bool Disconnect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(_Params...),
+			McDisconnectMode mode = McDisconnectMode::Async) {
+			return disconnectMember(sender_id, reciever, callback, mode);
+		}
+
+		template<class _Reciever, class ..._Signature>
+		static inline bool Disconnect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(McBatch<_Signature...>),
+			McDisconnectMode mode = McDisconnectMode::Async) {
+			return disconnectMember(sender_id, reciever, callback, mode);
+		}
+
+		template<class ..._Signature>
+		static inline bool Disconnect(const McSignal<_Signature...>& sender_id, void(*callback)(_Signature...), McDisconnectMode mode = McDisconnectMode::Async) {
+			return disconnectFunction(sender_id, callback, mode);
+		}
+
+		template<class ..._Signature, class ..._Params>
+		static inline bool Disconnect(const McSignal<_Signature...>& sender_id, void(*callback)(_Params...), McDisconnectMode mode = McDisconnectMode::Async) {
+			return disconnectFunction(sender_id, callback, mode);
+		}
 
-			inline void call(const Argument& args) const noexcept override {
-				args.try_to_dispatch<void(Args...)>(raw_data.storage.func);
+		template<class ..._Signature>
+		static inline bool Disconnect(const McSignal<_Signature...>& sender_id, const McFunctionId& reciever_id, McDisconnectMode mode = McDisconnectMode::Async) {
+			const McSignalId signal_id = sender_id.id();
+			if (!signal_id.sender) {
+				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
+				return false;
 			}
-		};
+			return disconnect(signal_id, McSubscriberKey(reciever_id), reciever_id.getObject(), mode);
+		}
 
-	private:
-		InternalImplBase* m_impl = nullptr;
-		alignas(size_t) uint8_t m_small_starage_buffer[sizeof(size_t) * 6]; // 6 is emperic. Just enough to put pointers to an object and a method with vtbl here
 
-		static const inline size_t m_magical_constant = 0x9e3779b9;
+		//Sets up the mailbox of queued connections to this object. Must be called before the first queued connection is made.
+		inline bool SetupMailbox(size_t capacity, McOverflowPolicy policy) {
+			__ConnectionState& state = connectionState();
+			std::unique_lock locker(state.senders_mutex);
+			if (state.mailbox) {
+				return false;
+			}
+			state.mailbox = std::make_shared<McMailbox>(capacity, policy);
+			return true;
+		}
 
-		void deleteImpl() noexcept {
-			if (m_impl) {
-				if (reinterpret_cast<const size_t*>(m_small_starage_buffer)[0] == m_magical_constant &&
-					reinterpret_cast<const size_t*>(m_small_starage_buffer)[1] == m_magical_constant)
-				{
-					delete m_impl;
-				}
-				else
-				{
-					m_impl->~InternalImplBase(); //placement new was used
-				}
-				m_impl = nullptr;
+		//Sets up a mailbox made elsewhere, e.g. by McDispatcher::bind(). Must be called before the first queued connection is made.
+		inline bool SetupMailbox(std::shared_ptr<McMailbox> mailbox) {
+			if (!mailbox) {
+				return false;
+			}
+			__ConnectionState& state = connectionState();
+			std::unique_lock locker(state.senders_mutex);
+			if (state.mailbox) {
+				return false;
 			}
+			state.mailbox = std::move(mailbox);
+			return true;
 		}
 
-		InternalImplBase* clone_impl_to(void* buffer) const noexcept {
-			if (m_impl) {
-				if (reinterpret_cast<const size_t*>(m_small_starage_buffer)[0] == m_magical_constant &&
-					reinterpret_cast<const size_t*>(m_small_starage_buffer)[1] == m_magical_constant)
-				{
-					return m_impl->clone_to();
-				}
-				else
-				{
-					return m_impl->clone_to(buffer); //placement new was used
-				}
+		//Calls the events that queued connections have put into the mailbox of this object. Call it on the thread that owns the object.
+		inline size_t ProcessEvents(size_t max_count = SIZE_MAX) {
+			__ConnectionState* state = existingState();
+			if (!state) {
+				return 0;
 			}
-			return nullptr;
+			std::shared_lock locker(state->senders_mutex);
+			std::shared_ptr<McMailbox> mailbox = state->mailbox;
+			locker.unlock();
+			return mailbox ? mailbox->processEvents(max_count) : 0;
 		}
 
-		InternalImplBase* move_impl_to(void* buffer) noexcept {
-			if (m_impl) {
-				if (reinterpret_cast<const size_t*>(m_small_starage_buffer)[0] == m_magical_constant &&
-					reinterpret_cast<const size_t*>(m_small_starage_buffer)[1] == m_magical_constant)
-				{
-					InternalImplBase* temp = m_impl->move_to();
-					m_impl = nullptr;
-					return temp;
+		//Signals of this object with their subscribers, and the signals this object is connected to
+		inline McConnectionGraph ConnectionGraph() const {
+			const __ConnectionState* state = existingState();
+			if (!state) {
+				return McConnectionGraph{ this, {}, {}, McLockStats{} };
+			}
+			const McLockStats table_lock = state->mutex.metrics.stats();
+			const McLockStats senders_lock = state->senders_mutex.metrics.stats();
+			McConnectionGraph graph{ this, {}, {}, McLockStats{ table_lock.contentions + senders_lock.contentions, table_lock.wait_ns + senders_lock.wait_ns } };
+			const __SignalTable* table = state->signal_table.load(std::memory_order_acquire);
+			const std::vector<__InterfaceRecievers> no_interfaces;
+			for (const auto& interface_recievers : table ? table->interfaces : no_interfaces) {
+				for (size_t index = 0; index < interface_recievers.signals.size(); ++index) {
+					const __SignalRecievers* signal_recievers = interface_recievers.signals[index];
+					if (!signal_recievers) {
+						continue;
+					}
+					std::shared_lock locker(signal_recievers->mutex);
+					const __RecieversList& subscribers = signal_recievers->list;
+					if (!subscribers.snapshot) {
+						continue;
+					}
+					McConnectionGraph::Signal& signal = graph.signals.emplace_back(McConnectionGraph::Signal{ interface_recievers.interface_tag, index, 0, {},
+						signal_recievers->mutex.metrics.stats() });
+					const __RecieversStorage& storage = *subscribers.snapshot;
+#if MC_ENABLE_METRICS
+					signal.emits = storage.metrics->emits.load(std::memory_order_relaxed);
+#endif
+					signal.subscribers.resize(storage.owners.size(), McConnectionGraph::Subscriber{ nullptr, {} });
+					for (const auto& [subscriber_key, owner] : subscribers.index) {
+						for (size_t i = 0; i < storage.owners.size(); ++i) {
+							if (storage.owners[i] == owner) {
+								signal.subscribers[i].reciever = subscriber_key.id.getObject();
+#if MC_ENABLE_METRICS
+								signal.subscribers[i].dispatch = storage.dispatch_metrics[i]->stats();
+#endif
+								break;
+							}
+						}
+					}
 				}
-				else
-				{
-					return m_impl->move_to(buffer); //placement new was used
+			}
+			std::shared_lock senders_locker(state->senders_mutex);
+			for (const auto& [sender_id, subscriber_keys] : state->senders_map) {
+				for (size_t i = 0; i < subscriber_keys.size(); ++i) {
+					graph.sources.push_back(McConnectionGraph::Source{ sender_id.sender, sender_id.interface_tag, sender_id.index });
 				}
 			}
-			return nullptr;
+			return graph;
 		}
 
+		//Human-readable ConnectionGraph(), one line per signal, subscriber and source
+		inline std::string DumpConnectionGraph() const {
+			const McConnectionGraph graph = ConnectionGraph();
+			std::string result;
+			char line[256];
+			snprintf(line, sizeof(line), "object %p: lock contentions %llu, wait %llu ns\n", static_cast<const void*>(graph.object),
+				static_cast<unsigned long long>(graph.lock.contentions), static_cast<unsigned long long>(graph.lock.wait_ns));
+			result += line;
+			for (const McConnectionGraph::Signal& signal : graph.signals) {
+				snprintf(line, sizeof(line), "  signal %p#%zu: %zu subscribers, %llu emits, lock contentions %llu, wait %llu ns\n", static_cast<const void*>(signal.interface_tag),
+					signal.index, signal.subscribers.size(), static_cast<unsigned long long>(signal.emits), static_cast<unsigned long long>(signal.lock.contentions),
+					static_cast<unsigned long long>(signal.lock.wait_ns));
+				result += line;
+				for (const McConnectionGraph::Subscriber& subscriber : signal.subscribers) {
+					snprintf(line, sizeof(line), "    -> %p: %llu calls, total %llu ns, max %llu ns\n", static_cast<const void*>(subscriber.reciever),
+						static_cast<unsigned long long>(subscriber.dispatch.calls), static_cast<unsigned long long>(subscriber.dispatch.total_ns),
+						static_cast<unsigned long long>(subscriber.dispatch.max_ns));
+					result += line;
+				}
+			}
+			for (const McConnectionGraph::Source& source : graph.sources) {
+				snprintf(line, sizeof(line), "  <- %p signal %p#%zu\n", static_cast<const void*>(source.sender), static_cast<const void*>(source.interface_tag), source.index);
+				result += line;
+			}
+			return result;
+		}
 
-		friend McFunctionId;
-
-		template<class ...Args, class T, class F>
-		inline void setContent(T* obj, F func) noexcept {
-			static_assert(std::is_member_function_pointer_v<F>);
-			deleteImpl();
-			if constexpr (sizeof(InternalImplMember<T, F, Args...>) < sizeof(m_small_starage_buffer)) {
-				m_impl = new(m_small_starage_buffer) InternalImplMember<T, F, Args...>(obj, func);
+	protected:
+		//Subscribers are published as immutable snapshots (RCU-style): writers build a new set and swap the pointer,
+		//so McEmit() only has to grab a reference to the current snapshot instead of copying the whole set.
+		//slot (if any) gets the owner of the subscriber, or of the one already connected with the same key
+		inline virtual bool addSubscriber(const McSignalId& signal_id, const McSubscriberKey& subscriber_key, McSubscriber subscriber, std::weak_ptr<const void>* slot = nullptr) {
+			__SignalRecievers& signal = recieversOf(signal_id);
+			std::unique_lock locker(signal.mutex);
+			__RecieversList& subscribers = signal.list;
+			auto index_it = subscribers.index.find(subscriber_key);
+			if (index_it != subscribers.index.end()) {
+				if (slot) {
+					*slot = index_it->second;
+				}
+				return true;
+			}
+			auto new_subscribers = McMakeShared<__RecieversStorage>();
+			const size_t old_size = subscribers.snapshot ? subscribers.snapshot->entries.size() : 0;
+			new_subscribers->entries.reserve(old_size + 1);
+			new_subscribers->owners.reserve(old_size + 1);
+			new_subscribers->batch_thunks.reserve(old_size + 1);
+			if (subscribers.snapshot) {
+				new_subscribers->entries = subscribers.snapshot->entries;
+				new_subscribers->owners = subscribers.snapshot->owners;
+				new_subscribers->batch_thunks = subscribers.snapshot->batch_thunks;
+				new_subscribers->plain_count = subscribers.snapshot->plain_count;
+				new_subscribers->keys = subscribers.snapshot->keys;
+			}
+			//a plain subscriber goes before the keyed ones, so it's the end of the list unless the signal has keyed subscribers
+			const bool keyed = subscriber.route.hash_thunk != nullptr;
+			const size_t position = keyed ? old_size : new_subscribers->plain_count;
+			new_subscribers->entries.insert(new_subscribers->entries.begin() + position, subscriber.entry);
+			new_subscribers->owners.insert(new_subscribers->owners.begin() + position, subscriber.owner);
+			new_subscribers->batch_thunks.insert(new_subscribers->batch_thunks.begin() + position, subscriber.batch_thunk);
+			if (keyed) {
+				new_subscribers->keys.push_back(subscriber.route);
 			}else {
-				reinterpret_cast<size_t*>(m_small_starage_buffer)[0] = m_magical_constant;
-				reinterpret_cast<size_t*>(m_small_starage_buffer)[1] = m_magical_constant; //to understand that it wasn't used
-				m_impl = new InternalImplMember<T, F, Args...>(obj, func);
+				++new_subscribers->plain_count;
 			}
-		}
-		template<class ...Args, class F>
-		inline void setContent(F func) noexcept {
-			//static_assert(std::is_member_function_pointer_v<F>);
-			deleteImpl();
-			if constexpr (sizeof(InternalImplFunction<F, Args...>) < sizeof(m_small_starage_buffer)) {
-				m_impl = new(m_small_starage_buffer) InternalImplFunction<F, Args...>(func);
+			indexRoutes(*new_subscribers);
+#if MC_ENABLE_METRICS
+			if (subscribers.snapshot) {
+				new_subscribers->metrics = subscribers.snapshot->metrics;
+				new_subscribers->dispatch_metrics = subscribers.snapshot->dispatch_metrics;
 			}else {
-				reinterpret_cast<size_t*>(m_small_starage_buffer)[0] = m_magical_constant;
-				reinterpret_cast<size_t*>(m_small_starage_buffer)[1] = m_magical_constant; //to understand that it wasn't used
-				m_impl = new InternalImplFunction<F, Args...>(func);
+				new_subscribers->metrics = McMakeShared<McSignalMetrics>();
+			}
+			new_subscribers->dispatch_metrics.insert(new_subscribers->dispatch_metrics.begin() + position, McMakeShared<McDispatchMetrics>());
+#endif
+#if MC_ENABLE_TRACING
+			new_subscribers->signal = signal_id;
+			if (subscribers.snapshot) {
+				new_subscribers->recievers = subscribers.snapshot->recievers;
 			}
+			new_subscribers->recievers.insert(new_subscribers->recievers.begin() + position, subscriber_key.id.getObject());
+#endif
+			if (slot) {
+				*slot = subscriber.owner;
+			}
+			subscribers.index.emplace(subscriber_key, std::move(subscriber.owner));
+			publish(subscribers, std::move(new_subscribers));
+			return true;
 		}
 
-		inline bool operator == (const McFunctionIdImpl& other) const noexcept { return m_impl->compare(other.m_impl); }
-		inline size_t hash() const noexcept { return m_impl->hash(); }
-		inline MultiCallBase* getObject() const noexcept { return m_impl->getObject(); }
-	};
-
-	template<class ...Args>
-	struct ArgsPlaceholder {};
-
-	class McFunctionId {
-	public:
-		McFunctionId() = default;
-
-		template<class ...Args>
-		inline McFunctionId(void(*func)(Args...)) noexcept { m_impl.setContent<Args...>(func); }
-
-		template<class ...Args, class T>
-		inline McFunctionId(T* obj, void(T::* func)(Args...)) noexcept { m_impl.setContent<Args...>(obj, func); }
+		//waited (if any) gets the snapshots whose running emits may still call the removed subscriber, see waitForEmits()
+		inline virtual bool removeSubscriber(const McSignalId& signal_id, const McSubscriberKey& subscriber_key, std::vector<__RecieversSnapshot>* waited = nullptr) {
+			__SignalRecievers* signal = findRecievers(signal_id.interface_tag, signal_id.index);
+			if (!signal) {
+				return true;
+			}
+			std::unique_lock locker(signal->mutex);
+			__RecieversList& subscribers = signal->list;
+			auto index_it = subscribers.index.find(subscriber_key);
+			if (index_it == subscribers.index.end()) {
+				return true;
+			}
+			const void* removed = index_it->second.get();
+			if (waited) {
+				runningSnapshots(subscribers, [removed](const __RecieversStorage& snapshot) { return snapshot.contains(removed); }, *waited);
+			}
+			subscribers.index.erase(index_it);
+			republish(subscribers, [removed](const void* owner) { return owner == removed; });
+			return true;
+		}
 
-		template<class ...Args, class F>
-		inline McFunctionId(ArgsPlaceholder<Args...>, F func) noexcept { m_impl.setContent<Args...>(func); }
+		//Removes all the subscribers of the keys from one signal, publishing one new snapshot. waited (if any) gets the snapshots that may still call them.
+		inline virtual void removeSubscribers(const McSignalId& signal_id, const __SendersStorage& subscriber_keys, std::vector<__RecieversSnapshot>* waited = nullptr) {
+			std::vector<const void*> removed;
+			removed.reserve(subscriber_keys.size());
+			__SignalRecievers* signal = findRecievers(signal_id.interface_tag, signal_id.index);
+			if (!signal) {
+				return;
+			}
+			std::unique_lock locker(signal->mutex);
+			__RecieversList& subscribers = signal->list;
+			for (const McSubscriberKey& subscriber_key : subscriber_keys) {
+				auto index_it = subscribers.index.find(subscriber_key);
+				if (index_it != subscribers.index.end()) {
+					removed.push_back(index_it->second.get());
+					subscribers.index.erase(index_it);
+				}
+			}
+			if (removed.empty()) {
+				return;
+			}
+			std::sort(removed.begin(), removed.end());
+			if (waited) {
+				runningSnapshots(subscribers, [&removed](const __RecieversStorage& snapshot) {
+					return std::any_of(removed.begin(), removed.end(), [&snapshot](const void* owner) { return snapshot.contains(owner); });
+				}, *waited);
+			}
+			republish(subscribers, [&removed](const void* owner) { return std::binary_search(removed.begin(), removed.end(), owner); });
+		}
 
-		inline bool operator == (const McFunctionId& other) const noexcept {
-			return (m_impl.isValid() && (m_impl.isValid() == other.m_impl.isValid())) ? m_impl == other.m_impl : false;
+		inline virtual void addSender(const McSignalId& sender_id, const McSubscriberKey& subscriber_key) {
+			__ConnectionState& state = connectionState();
+			std::unique_lock locker(state.senders_mutex);
+			state.senders_map[sender_id].insert(subscriber_key);
 		}
-		inline size_t hash() const noexcept { return m_impl.isValid() ? m_impl.hash() : 0; }
-		inline MultiCallBase* getObject() const noexcept { return m_impl.isValid() ? m_impl.getObject() : nullptr; }
 
-		template<class ...Args>
-		inline void call(Args && ...args) const noexcept {
-			m_impl.call(std::forward<Args>(args)...);
+		inline virtual void removeSender(const McSignalId& sender_id, const McSubscriberKey& subscriber_key) {
+			__ConnectionState* state = existingState();
+			if (!state) {
+				return;
+			}
+			std::unique_lock locker(state->senders_mutex);
+			auto senders_it = state->senders_map.find(sender_id);
+			if (senders_it != state->senders_map.end()) {
+				senders_it->second.erase(subscriber_key);
+				if (senders_it->second.empty()) {
+					state->senders_map.erase(senders_it);
+				}
+			}
 		}
 
-	private:
-		McFunctionIdImpl m_impl;
-		bool m_active = true;
-	};
+		inline virtual void removeSenders(const McSignalId& sender_id, const __SendersStorage& subscriber_keys) {
+			__ConnectionState* state = existingState();
+			if (!state) {
+				return;
+			}
+			std::unique_lock locker(state->senders_mutex);
+			auto senders_it = state->senders_map.find(sender_id);
+			if (senders_it != state->senders_map.end()) {
+				for (const McSubscriberKey& subscriber_key : subscriber_keys) {
+					senders_it->second.erase(subscriber_key);
+				}
+				if (senders_it->second.empty()) {
+					state->senders_map.erase(senders_it);
+				}
+			}
+		}
 
-	struct McFunctionIdHash
-	{
-		size_t operator() (const McFunctionId& k) const noexcept {
-			return k.hash();
+		template<class... _Signature>
+		inline void McEmit(const McSignal<_Signature...>& signal_id, _Signature... args) {
+			const __RecieversSnapshot subscribers = snapshotOf(signal_id); //keeps the snapshot alive even if it is replaced meanwhile
+			if (subscribers) {
+				const __EmitScope scope(subscribers.get()); //published snapshots are never empty
+				//The arguments are packed once, every subscriber gets references to them and the last one may take them by move
+				McEmitArgs<_Signature...> emit_args(args...);
+#if MC_ENABLE_TRACING
+				const McTraceSlice trace(McTraceEvent::Kind::EmitBegin, this, signal_id.m_interface_tag, signal_id.m_index);
+#endif
+				const McSubscriberEntry* entries = subscribers->entries.data();
+				countEmits(*subscribers, 1);
+				if (subscribers->routes.empty()) {
+					const size_t last = subscribers->entries.size() - 1;
+					for (size_t i = 0; i < last; ++i) {
+						dispatch(*subscribers, i, [&]() { entries[i].call(emit_args); });
+					}
+					emit_args.setMovable(true);
+					dispatch(*subscribers, last, [&]() { entries[last].call(emit_args); });
+				}else {
+					//only the keyed subscribers of the key of the arguments are called, and none of them may take the arguments
+					for (size_t i = 0; i < subscribers->plain_count; ++i) {
+						dispatch(*subscribers, i, [&]() { entries[i].call(emit_args); });
+					}
+					emitRouted(*subscribers, emit_args);
+				}
+			}
 		}
-	};
 
-	template<class... Args>
-	struct McSignal {
-		template<class _Sender, class _Interface>
-		McSignal(_Sender* obj, void(_Interface::* func)(Args...)) 
-			: m_func_id(static_cast<_Interface*>(obj), func)
-		{
-			static_assert(std::is_same_v<typename _Interface::__MC_IINTERFACE, _Interface>, "The type of sender must be the same as type of the interface");
+		//Delivers the whole burst to every subscriber in turn, taking the lock and the snapshot once.
+		//Batch-aware subscribers get the batch in one call, the others get the events one by one.
+		template<class... _Signature>
+		inline void McEmitBatch(const McSignal<_Signature...>& signal_id, typename McSignal<_Signature...>::Batch events) {
+			static_assert(McCopyableArgs<_Signature...>::value, "The events of a batch are shared by the subscribers, they must be copyable");
+			if (events.empty()) {
+				return;
+			}
+			const __RecieversSnapshot subscribers = snapshotOf(signal_id);
+			if (!subscribers) {
+				return;
+			}
+			const __EmitScope scope(subscribers.get());
+			const size_t count = subscribers->entries.size();
+#if MC_ENABLE_TRACING
+			const McTraceSlice trace(McTraceEvent::Kind::EmitBegin, this, signal_id.m_interface_tag, signal_id.m_index);
+#endif
+			countEmits(*subscribers, events.size());
+			for (size_t i = 0; i < count; ++i) {
+				const McSubscriberEntry& subscriber = subscribers->entries[i];
+				const McSubscriberEntry::ErasedThunk batch_thunk = subscribers->batch_thunks[i];
+				dispatch(*subscribers, i, [&]() {
+					if (batch_thunk) {
+						reinterpret_cast<McSubscriber::BatchThunk<_Signature...>>(batch_thunk)(subscriber.object, events);
+					}else {
+						for (const auto& event : events) {
+							subscriber.call(McEmitArgs<_Signature...>(event));
+						}
+					}
+				});
+			}
 		}
-		McFunctionId m_func_id;
-	};
 
-	class MultiCallBase
-	{
-	public:
-		virtual ~MultiCallBase() {
-			DisconnectFromAll();
-		};
+		//Splits the subscribers into chunks of chunk_size (0 - automatically) and calls them on the pool.
+		//The arguments are moved into one pack shared by all the chunks. Subscribers may be disconnected meanwhile, as with McEmit().
+		template<class... _Signature>
+		inline void McEmitParallel(McThreadPool& pool, McParallelMode mode, size_t chunk_size, const McSignal<_Signature...>& signal_id, _Signature... args) {
+			static_assert(McCopyableArgs<_Signature...>::value, "The chunks of McEmitParallel() share the arguments, they must be copyable");
+			__RecieversSnapshot subscribers = snapshotOf(signal_id);
+			if (!subscribers) {
+				return;
+			}
+#if MC_ENABLE_TRACING
+			const McTraceSlice trace(McTraceEvent::Kind::EmitBegin, this, signal_id.m_interface_tag, signal_id.m_index); //the calls are traced on the workers
+#endif
+			const size_t count = subscribers->entries.size();
+			if (chunk_size == 0) {
+				chunk_size = std::max<size_t>(16, count / (pool.size() * 4));
+			}
+			struct ParallelEmit {
+				ParallelEmit(__RecieversSnapshot subscribers_, size_t chunks, std::shared_ptr<const std::tuple<std::decay_t<_Signature>...>> args_)
+					: subscribers(std::move(subscribers_)), args(std::move(args_)), pending_chunks(chunks) {}
 
-		inline void DisconnectFromAll() {
-			std::unique_lock locker(__m_mutex);
-			for (auto& [reciever_id, senders] : __m_senders_map) {
-				for (auto& sender : senders) {
-					MultiCallBase* sender_obj = sender.getObject();
-					if (sender_obj) {
-						sender_obj->removeSubscriber(sender, reciever_id);
-					}
+				__RecieversSnapshot subscribers;
+				std::shared_ptr<const std::tuple<std::decay_t<_Signature>...>> args;
+				std::atomic<size_t> pending_chunks;
+			};
+			McEmitArgs<_Signature...> emit_args(args...);
+			emit_args.setMovable(true);
+			countEmits(*subscribers, 1);
+			auto emit = McMakeShared<ParallelEmit>(std::move(subscribers), (count + chunk_size - 1) / chunk_size, emit_args.shared());
+			{
+				//counts this emit until every chunk counts itself. Nothing of this thread is counted while it waits, so a chunk may wait for the others.
+				const __EmitScope submitting(emit->subscribers.get());
+				for (size_t begin = 0; begin < count; begin += chunk_size) {
+					const size_t end = std::min(begin + chunk_size, count);
+					emit->subscribers->in_flight.fetch_add(1, std::memory_order_relaxed);
+					pool.submit([emit, begin, end]() {
+						const McSubscriberEntry* entries = emit->subscribers->entries.data();
+						const __EmitScope scope(emit->subscribers.get());
+						for (size_t i = begin; i < end; ++i) {
+							dispatch(*emit->subscribers, i, [&]() { entries[i].call(McEmitArgs<_Signature...>(emit->args)); });
+						}
+						--emit->pending_chunks;
+					});
 				}
 			}
-			for (auto& [sender_id, recievers] : __m_mc_recievers_map) {
-				for (auto& reciever : recievers) {
-					MultiCallBase* reciever_obj = reciever.getObject();
-					if (reciever_obj) {
-						reciever_obj->removeSender(sender_id, reciever);
+			if (mode == McParallelMode::Wait) {
+				while (emit->pending_chunks > 0) {
+					if (!pool.runOne()) {
+						std::this_thread::yield();
 					}
 				}
 			}
 		}
 
-		template<class _Reciever, class ..._Signature>
-		static inline std::pair<bool, McFunctionId> Connect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(_Signature...)) {
-			MultiCallBase* sender_object = sender_id.m_func_id.getObject();
-			if (!sender_object) {
+	private:
+		friend McConnection;
+
+		template<class _Reciever, class F, class ..._Signature, class Route = std::nullptr_t>
+		static inline McConnection connectMember(const McSignal<_Signature...>& sender_id, _Reciever* reciever, F callback, McConnectionType type, McThrottle throttle, Route route = nullptr) {
+			const McSignalId signal_id = sender_id.id();
+			if (!signal_id.sender) {
 				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
-				return std::make_pair(false, McFunctionId());
+				return McConnection();
 			}
-			MultiCallBase* reciever_object = dynamic_cast<MultiCallBase*>(reciever);
+			McFunctionId reciever_id(ArgsPlaceholder<_Signature...>{}, reciever, callback);
+			MultiCallBase* reciever_object = reciever_id.getObject();
 			if (!reciever_object) {
 				//std::cerr << "Reciever doesn't inherits to MultiCallBase!\n";
-				return std::make_pair(false, McFunctionId());
+				return McConnection();
 			}
-			McFunctionId reciever_id(reciever, callback);
-			const bool result = sender_object->addSubscriber(sender_id.m_func_id, reciever_id);
-			if (result) {
-				reciever_object->addSender(sender_id.m_func_id, reciever_id);
+			McSubscriber subscriber = McSubscriber::direct(reciever_id);
+			if constexpr (McCopyableArgs<_Signature...>::value) {
+				switch (type) {
+					case McConnectionType::Direct:
+						break;
+					case McConnectionType::Queued:
+						subscriber = McQueuedSubscriber::make<_Signature...>(reciever_id, reciever_object->mailbox());
+						break;
+					case McConnectionType::Latest:
+						subscriber = McLatestSubscriber<_Signature...>::make(reciever_id, reciever_object->mailbox());
+						break;
+				}
+			}else if (type != McConnectionType::Direct) {
+				//std::cerr << "Queued and latest connections keep the arguments, a move-only one can't be shared!\n";
+				return McConnection(); //the type is known at run time only, so it can't be rejected at compile time
 			}
-			return std::make_pair(result, reciever_id);
+			return connect(signal_id, reciever_object, reciever_id, routed<_Signature...>(throttled<_Signature...>(std::move(subscriber), throttle), std::move(route)));
 		}
 
-		template<class ..._Signature>
-		static inline std::pair<bool, McFunctionId> Connect(const McSignal<_Signature...>& sender_id, void(*callback)(_Signature...)) {
-			MultiCallBase* sender_object = sender_id.m_func_id.getObject();
-			if (!sender_object) {
+		template<class F, class ..._Signature, class Route = std::nullptr_t>
+		static inline McConnection connectFunction(const McSignal<_Signature...>& sender_id, F callback, McThrottle throttle, Route route = nullptr) {
+			const McSignalId signal_id = sender_id.id();
+			if (!signal_id.sender) {
 				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
-				return std::make_pair(false, McFunctionId());
+				return McConnection();
 			}
-			McFunctionId reciever_id(callback);
-			const bool result = sender_object->addSubscriber(sender_id.m_func_id, reciever_id);
-			return std::make_pair(result, reciever_id);
+			McFunctionId reciever_id(ArgsPlaceholder<_Signature...>{}, callback);
+			return connect(signal_id, nullptr, reciever_id, routed<_Signature...>(throttled<_Signature...>(McSubscriber::direct(reciever_id), throttle), std::move(route)));
 		}
 
-		template<class ..._Signature, class F>
-		static inline std::pair<bool, McFunctionId> Connect(const McSignal<_Signature...>& sender_id, F callback) {
-			static_assert(std::is_convertible_v<F, std::function<void(_Signature...)>>, "F must be convertible to std::function");
-			MultiCallBase* sender_object = sender_id.m_func_id.getObject();
-			if (!sender_object) {
-				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
-				return std::make_pair(false, McFunctionId());
+		static inline McConnection connect(const McSignalId& signal_id, MultiCallBase* reciever_object, const McFunctionId& reciever_id, McSubscriber subscriber) {
+			McConnection connection;
+			McSubscriberKey key(reciever_id, subscriber.salt, subscriber.route_key);
+			if (signal_id.sender->addSubscriber(signal_id, key, std::move(subscriber), &connection.m_slot)) {
+				if (reciever_object) {
+					reciever_object->addSender(signal_id, key);
+				}
+				connection.m_signal = signal_id;
+				connection.m_key = std::move(key);
+				connection.m_reciever = reciever_object;
 			}
-			McFunctionId reciever_id(ArgsPlaceholder<_Signature...>{}, callback);
-			const bool result = sender_object->addSubscriber(sender_id.m_func_id, reciever_id);
-			return std::make_pair(result, reciever_id);
+			return connection;
 		}
 
-		template<class _Reciever, class ..._Signature>
-		static inline bool Disconnect(const McSignal<_Signature...>& sender_id, _Reciever* reciever, void(_Reciever::* callback)(_Signature...)) {
-			MultiCallBase* sender_object = sender_id.m_func_id.getObject();
-			if (!sender_object) {
+		template<class _Reciever, class F, class ..._Signature>
+		static inline bool disconnectMember(const McSignal<_Signature...>& sender_id, _Reciever* reciever, F callback, McDisconnectMode mode) {
+			const McSignalId signal_id = sender_id.id();
+			if (!signal_id.sender) {
 				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
 				return false;
 			}
-			MultiCallBase* reciever_object = dynamic_cast<MultiCallBase*>(reciever);
-			if (!reciever_object) {
+			const McSubscriberKey key(McFunctionId(reciever, callback));
+			if (!key.id.getObject()) {
 				//std::cerr << "Reciever doesn't inherits to MultiCallBase!\n";
 				return false;
 			}
-			McFunctionId reciever_id(reciever, callback);
-			bool result = sender_object->removeSubscriber(sender_id.m_func_id, reciever_id);
-			if (result) {
-				reciever_object->removeSender(sender_id.m_func_id, reciever_id);
-			}
-			return result;
+			return disconnect(signal_id, key, key.id.getObject(), mode);
 		}
 
-		template<class ..._Signature>
-		static inline bool Disconnect(const McSignal<_Signature...>& sender_id, void(*callback)(_Signature...)) {
-			MultiCallBase* sender_object = sender_id.m_func_id.getObject();
-			if (!sender_object) {
+		template<class F, class ..._Signature>
+		static inline bool disconnectFunction(const McSignal<_Signature...>& sender_id, F callback, McDisconnectMode mode) {
+			const McSignalId signal_id = sender_id.id();
+			if (!signal_id.sender) {
 				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
 				return false;
 			}
-			McFunctionId reciever_id(callback);
-			return sender_object->removeSubscriber(sender_id.m_func_id, reciever_id);
+			return disconnect(signal_id, McSubscriberKey(McFunctionId(callback)), nullptr, mode);
+		}
+
+		//reciever_object (if any) has the connection in its senders bookkeeping
+		static inline bool disconnect(const McSignalId& signal_id, const McSubscriberKey& key, MultiCallBase* reciever_object, McDisconnectMode mode) {
+			std::vector<__RecieversSnapshot> waited;
+			const bool result = signal_id.sender->removeSubscriber(signal_id, key, mode == McDisconnectMode::Wait ? &waited : nullptr);
+			if (result && reciever_object) {
+				reciever_object->removeSender(signal_id, key);
+			}
+			waitForEmits(waited);
+			return result;
+		}
+
+		//The keyed entries of a snapshot with the same key extractor, by the hash of the key
+		struct __KeyRoute {
+			McSubscriberRoute key; //hash_thunk and extractor of the route
+			std::unordered_map<size_t, std::vector<size_t, McAllocator<size_t>>, std::hash<size_t>, std::equal_to<size_t>,
+				McAllocator<std::pair<const size_t, std::vector<size_t, McAllocator<size_t>>>>> buckets;
+		};
+		struct __RecieversStorage {
+			std::vector<McSubscriberEntry, McAllocator<McSubscriberEntry>> entries; //what McEmit() iterates, in the order of connection
+			std::vector<std::shared_ptr<const void>, McAllocator<std::shared_ptr<const void>>> owners; //keep the callables of the entries alive, same order
+			std::vector<McSubscriberEntry::ErasedThunk, McAllocator<McSubscriberEntry::ErasedThunk>> batch_thunks; //McSubscriber::batch_thunk of the entries, same order. Only McEmitBatch() reads it
+			size_t plain_count = 0; //the entries before it get every emit, the keyed ones follow them
+			std::vector<McSubscriberRoute, McAllocator<McSubscriberRoute>> keys; //of the keyed entries, keys[i] is of entries[plain_count + i]
+			std::vector<__KeyRoute, McAllocator<__KeyRoute>> routes; //index of the keyed entries, one per kind of key
+#if MC_ENABLE_METRICS
+			std::shared_ptr<McSignalMetrics> metrics; //passed from snapshot to snapshot
+			std::vector<std::shared_ptr<McDispatchMetrics>, McAllocator<std::shared_ptr<McDispatchMetrics>>> dispatch_metrics; //of the entries, same order
+#endif
+#if MC_ENABLE_TRACING
+			McSignalId signal; //what the trace events of the calls name
+			std::vector<const MultiCallBase*, McAllocator<const MultiCallBase*>> recievers; //of the entries, same order, nullptr for callbacks without an object
+#endif
+			mutable std::atomic<size_t> in_flight{ 0 }; //the emits iterating the snapshot, counted by snapshotOf() and released by __EmitScope
+
+			inline bool contains(const void* owner) const noexcept {
+				return std::any_of(owners.begin(), owners.end(), [owner](const auto& snapshot_owner) { return snapshot_owner.get() == owner; });
+			}
+		};
+		//An emit iterating a snapshot. Takes over the in_flight count the emit got with the snapshot and releases it at the end.
+		//Records the snapshots of the emits running on this thread, Disconnect() called from a subscriber doesn't wait for them.
+		struct __EmitScope {
+			static constexpr size_t max_depth = 32; //deeper nested emits aren't recorded, waitForEmits() doesn't wait under them
+			static inline thread_local const __RecieversStorage* t_snapshots[max_depth];
+			static inline thread_local size_t t_depth = 0;
+
+			explicit __EmitScope(const __RecieversStorage* snapshot) noexcept : m_snapshot(snapshot) {
+				if (t_depth < max_depth) {
+					t_snapshots[t_depth] = snapshot;
+				}
+				++t_depth;
+			}
+			~__EmitScope() {
+				--t_depth;
+				m_snapshot->in_flight.fetch_sub(1, std::memory_order_release);
+			}
+			__EmitScope(const __EmitScope&) = delete;
+			__EmitScope& operator=(const __EmitScope&) = delete;
+
+		private:
+			const __RecieversStorage* m_snapshot;
+		};
+		struct __RecieversList {
+			__RecieversSnapshot snapshot;
+			std::vector<std::weak_ptr<const __RecieversStorage>> retired; //replaced snapshots that emits may still iterate
+			std::unordered_map<McSubscriberKey, std::shared_ptr<const void>, McSubscriberKeyHash, std::equal_to<McSubscriberKey>,
+				McAllocator<std::pair<const McSubscriberKey, std::shared_ptr<const void>>>> index; //for deduplication and disconnection, McEmit() doesn't touch it
+		};
+		//A signal with a lock of its own, so connecting to one signal doesn't stall the emits of the others.
+		//Created when the signal gets its first subscriber and kept until the object is destroyed.
+		struct __SignalRecievers : McPoolAllocated {
+			mutable MC_SHARED_MUTEX mutex;
+			__RecieversList list;
+		};
+		struct __InterfaceRecievers {
+			const char* interface_tag; //&McInterfaceTag<Interface>::id
+			std::vector<__SignalRecievers*> signals; //indexed by McSignalSlot index, null until the signal is connected to
+		};
+		//Immutable once published, a new signal publishes a copy. So finding a signal takes no lock.
+		struct __SignalTable {
+			std::vector<__InterfaceRecievers> interfaces; //one item per implemented interface, so the search is just a pointer comparison or two
+		};
+		//Everything an object has once it is connected to something (or has a mailbox). Idle objects don't allocate it.
+		struct __ConnectionState : McPoolAllocated {
+			std::atomic<const __SignalTable*> signal_table{ nullptr };
+			std::vector<std::unique_ptr<const __SignalTable>> signal_tables; //the published table and the replaced ones that emits may still read
+			std::vector<std::unique_ptr<__SignalRecievers>> signals; //the signals of the tables
+			__SendersMap senders_map; //connections of this object as a reciever, grouped by signal so the teardown visits every signal once
+			std::shared_ptr<McMailbox> mailbox; //created by the first queued connection to this object
+			mutable MC_SHARED_MUTEX mutex; //publishing of the signal tables, the subscribers of a signal are guarded by its own lock
+			mutable MC_SHARED_MUTEX senders_mutex; //this object as a reciever: senders_map and mailbox
+		};
+		std::atomic<__ConnectionState*> __m_state{ nullptr }; //set once, deleted by the destructor
+
+		inline __ConnectionState* existingState() const noexcept { return __m_state.load(std::memory_order_acquire); }
+
+		//Allocates the state on first use. Racing threads allocate one each, the loser frees its own.
+		inline __ConnectionState& connectionState() {
+			__ConnectionState* state = __m_state.load(std::memory_order_acquire);
+			if (!state) {
+				auto created = std::make_unique<__ConnectionState>();
+				if (__m_state.compare_exchange_strong(state, created.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+					state = created.release();
+				}
+			}
+			return *state;
+		}
+
+		//Replaces the published snapshot, the old one is kept as retired while someone else holds it
+		static inline void publish(__RecieversList& subscribers, __RecieversSnapshot new_subscribers) {
+			subscribers.retired.erase(std::remove_if(subscribers.retired.begin(), subscribers.retired.end(),
+				[](const auto& retired) { return retired.expired(); }), subscribers.retired.end());
+			if (subscribers.snapshot && subscribers.snapshot.use_count() > 1) {
+				subscribers.retired.push_back(subscribers.snapshot);
+			}
+			subscribers.snapshot = std::move(new_subscribers);
+		}
+
+		//Adds to waited the published and the retired snapshots that match, the emits running over them may still call what is removed
+		template<class Matches>
+		static inline void runningSnapshots(const __RecieversList& subscribers, Matches&& matches, std::vector<__RecieversSnapshot>& waited) {
+			if (subscribers.snapshot && matches(*subscribers.snapshot)) {
+				waited.push_back(subscribers.snapshot);
+			}
+			for (const auto& retired : subscribers.retired) {
+				__RecieversSnapshot snapshot = retired.lock();
+				if (snapshot && matches(*snapshot)) {
+					waited.push_back(std::move(snapshot));
+				}
+			}
+		}
+
+		//Publishes a new snapshot without the subscribers whose owners are removed, keeping the order of the others
+		template<class Removed>
+		static inline void republish(__RecieversList& subscribers, Removed&& is_removed) {
+			if (subscribers.index.empty()) {
+				publish(subscribers, nullptr);
+				return;
+			}
+			const __RecieversStorage& old_subscribers = *subscribers.snapshot;
+			auto new_subscribers = McMakeShared<__RecieversStorage>();
+			new_subscribers->entries.reserve(subscribers.index.size());
+			new_subscribers->owners.reserve(subscribers.index.size());
+			new_subscribers->batch_thunks.reserve(subscribers.index.size());
+			for (size_t i = 0; i < old_subscribers.owners.size(); ++i) {
+				if (!is_removed(old_subscribers.owners[i].get())) {
+					new_subscribers->entries.push_back(old_subscribers.entries[i]);
+					new_subscribers->owners.push_back(old_subscribers.owners[i]);
+					new_subscribers->batch_thunks.push_back(old_subscribers.batch_thunks[i]);
+					if (i < old_subscribers.plain_count) {
+						++new_subscribers->plain_count;
+					}else {
+						new_subscribers->keys.push_back(old_subscribers.keys[i - old_subscribers.plain_count]);
+					}
+#if MC_ENABLE_METRICS
+					new_subscribers->dispatch_metrics.push_back(old_subscribers.dispatch_metrics[i]);
+#endif
+#if MC_ENABLE_TRACING
+					new_subscribers->recievers.push_back(old_subscribers.recievers[i]);
+#endif
+				}
+			}
+			indexRoutes(*new_subscribers);
+#if MC_ENABLE_TRACING
+			new_subscribers->signal = old_subscribers.signal;
+#endif
+#if MC_ENABLE_METRICS
+			new_subscribers->metrics = old_subscribers.metrics;
+#endif
+			publish(subscribers, std::move(new_subscribers));
+		}
+
+		//Rebuilds the routes of the keyed entries
+		static inline void indexRoutes(__RecieversStorage& subscribers) {
+			subscribers.routes.clear();
+			for (size_t i = 0; i < subscribers.keys.size(); ++i) {
+				const McSubscriberRoute& key = subscribers.keys[i];
+				auto route = std::find_if(subscribers.routes.begin(), subscribers.routes.end(), [&key](const __KeyRoute& route) { return route.key.sameKeyOf(key); });
+				if (route == subscribers.routes.end()) {
+					route = subscribers.routes.insert(route, __KeyRoute{ key, {} });
+				}
+				route->buckets[key.hash].push_back(subscribers.plain_count + i);
+			}
 		}
 
+		//Calls the keyed entries whose key hash matches the arguments, in the order of connection within a route
 		template<class ..._Signature>
-		static inline bool Disconnect(const McSignal<_Signature...>& sender_id, const McFunctionId& reciever_id) {
-			MultiCallBase* sender_object = sender_id.m_func_id.getObject();
-			if (!sender_object) {
-				//std::cerr << "Sender doesn't inherits to MultiCallBase!\n";
-				return false;
+		static inline void emitRouted(const __RecieversStorage& subscribers, const McEmitArgs<_Signature...>& emit_args) {
+			for (const __KeyRoute& route : subscribers.routes) {
+				const size_t hash = reinterpret_cast<McSubscriberRoute::HashThunk<_Signature...>>(route.key.hash_thunk)(route.key.extractor, emit_args);
+				const auto bucket = route.buckets.find(hash);
+				if (bucket != route.buckets.end()) {
+					for (const size_t i : bucket->second) {
+						dispatch(subscribers, i, [&]() { subscribers.entries[i].call(emit_args); });
+					}
+				}
 			}
-			return sender_object->removeSubscriber(sender_id.m_func_id, reciever_id);
 		}
 
+		template<class ..._Signature>
+		static inline McSubscriber throttled(McSubscriber subscriber, McThrottle throttle) {
+			return throttle.max_calls_per_second > 0 ? McThrottledSubscriber<_Signature...>::make(std::move(subscriber), throttle) : subscriber;
+		}
 
-	protected:
-		inline virtual bool addSubscriber(const McFunctionId& signal_id, const McFunctionId& subscriber_id) {
-			std::unique_lock locker(__m_mutex);
-			__m_mc_recievers_map[signal_id].insert(subscriber_id);
-			return true;
+		template<class ..._Signature>
+		static inline McSubscriber routed(McSubscriber subscriber, std::nullptr_t) { return subscriber; }
+		template<class ..._Signature, class K, class E>
+		static inline McSubscriber routed(McSubscriber subscriber, McKey<K, E> key) { return McKeyedSubscriber<K, E, _Signature...>::make(std::move(subscriber), std::move(key)); }
+		template<class ..._Signature, class P>
+		static inline McSubscriber routed(McSubscriber subscriber, McFilter<P> filter) { return McFilteredSubscriber<P, _Signature...>::make(std::move(subscriber), std::move(filter)); }
+
+		//Waits until the emits of other threads over the snapshots end. The emits of this thread can't end while we wait, they aren't waited for.
+		//Nested deeper than __EmitScope::max_depth the own emits aren't all known, so it doesn't wait at all (as McDisconnectMode::Async).
+		static inline void waitForEmits(const std::vector<__RecieversSnapshot>& snapshots) noexcept {
+			if (snapshots.empty() || __EmitScope::t_depth > __EmitScope::max_depth) {
+				return;
+			}
+			for (const auto& snapshot : snapshots) {
+				const size_t own_emits = size_t(std::count(__EmitScope::t_snapshots, __EmitScope::t_snapshots + __EmitScope::t_depth, snapshot.get()));
+				for (size_t spins = 0; snapshot->in_flight.load(std::memory_order_acquire) > own_emits; ++spins) {
+					if (spins < 64) {
+						mcCpuRelax();
+					}else if (spins < 128) {
+						std::this_thread::yield();
+					}else {
+						std::this_thread::sleep_for(std::chrono::microseconds(std::min<size_t>(spins - 127, 1000)));
+					}
+				}
+			}
 		}
 
-		inline virtual bool removeSubscriber(const McFunctionId& signal_id, McFunctionId subscriber_id) {
-			std::unique_lock locker(__m_mutex);
-			__m_mc_recievers_map[signal_id].erase(subscriber_id);
-			return true;
+		static inline void countEmits(const __RecieversStorage& subscribers, size_t count) noexcept {
+#if MC_ENABLE_METRICS
+			subscribers.metrics->emits.fetch_add(count, std::memory_order_relaxed);
+#else
+			(void)subscribers;
+			(void)count;
+#endif
+		}
+
+		//Calls the subscriber i of the snapshot, measuring the call if the metrics are enabled and tracing it if McTracer is enabled
+		template<class Call>
+		static inline void dispatch(const __RecieversStorage& subscribers, size_t i, Call&& call) {
+#if MC_ENABLE_TRACING
+			if (McTracer::enabled()) {
+				const McTraceSlice trace(McTraceEvent::Kind::CallBegin, subscribers.signal.sender, subscribers.signal.interface_tag, subscribers.signal.index,
+					subscribers.recievers[i], subscribers.entries[i].object);
+				measure(subscribers, i, call);
+				return;
+			}
+#endif
+			measure(subscribers, i, call);
 		}
 
-		inline virtual void addSender(const McFunctionId& sender_id, const McFunctionId& subscriber_id) {
-			std::unique_lock locker(__m_mutex);
-			__m_senders_map[subscriber_id].insert(sender_id);
+		template<class Call>
+		static inline void measure(const __RecieversStorage& subscribers, size_t i, Call&& call) {
+#if MC_ENABLE_METRICS
+			const auto start = std::chrono::steady_clock::now();
+			call();
+			subscribers.dispatch_metrics[i]->record(std::chrono::steady_clock::now() - start);
+#else
+			(void)subscribers;
+			(void)i;
+			call();
+#endif
 		}
 
-		inline virtual void removeSender(const McFunctionId& sender_id, const McFunctionId& subscriber_id) {
-			std::unique_lock locker(__m_mutex);
-			__m_senders_map[subscriber_id].erase(sender_id);
+		inline std::shared_ptr<McMailbox> mailbox() {
+			__ConnectionState& state = connectionState();
+			std::unique_lock locker(state.senders_mutex);
+			if (!state.mailbox) {
+				state.mailbox = std::make_shared<McMailbox>(1024, McOverflowPolicy::Block);
+			}
+			return state.mailbox;
 		}
 
 		template<class... _Signature>
-		inline void McEmit(const McSignal<_Signature...>& signal_id, _Signature... args) {
-			std::shared_lock locker(__m_mutex);
-			auto subscribers_it = __m_mc_recievers_map.find(signal_id.m_func_id);
-			if (subscribers_it != __m_mc_recievers_map.end()) {
-				auto subscribers_copy = subscribers_it->second;
-				locker.unlock();
-				for (auto& funcId : subscribers_copy) {
-					funcId.call(std::forward<_Signature>(args)...);
+		inline __RecieversSnapshot snapshotOf(const McSignal<_Signature...>& signal_id) {
+			const __SignalRecievers* signal = findRecievers(signal_id.m_interface_tag, signal_id.m_index);
+			if (!signal) {
+				return nullptr;
+			}
+			std::shared_lock locker(signal->mutex);
+			if (signal->list.snapshot) {
+				signal->list.snapshot->in_flight.fetch_add(1, std::memory_order_relaxed); //under the lock, so Disconnect(Wait) sees it once the subscriber is removed
+			}
+			return signal->list.snapshot;
+		}
+
+		inline __SignalRecievers* findRecievers(const char* interface_tag, size_t index) const noexcept {
+			const __ConnectionState* state = existingState();
+			if (!state) {
+				return nullptr; //the emit of an object that was never connected to
+			}
+			const __SignalTable* table = state->signal_table.load(std::memory_order_acquire);
+			if (!table) {
+				return nullptr;
+			}
+			for (const auto& interface_recievers : table->interfaces) {
+				if (interface_recievers.interface_tag == interface_tag) {
+					return index < interface_recievers.signals.size() ? interface_recievers.signals[index] : nullptr;
 				}
 			}
+			return nullptr;
 		}
 
-	private:
-		using __RecieversStorage = std::unordered_set<McFunctionId, McFunctionIdHash>;
-		using __SendersStorage = std::unordered_set<McFunctionId, McFunctionIdHash>;
-		std::unordered_map<McFunctionId, __RecieversStorage, McFunctionIdHash> __m_mc_recievers_map;
-		std::unordered_map<McFunctionId, __SendersStorage, McFunctionIdHash> __m_senders_map;
-		SpinSharedMutex __m_mutex;
+		//Finds the signal, publishing a new table with it if needed
+		inline __SignalRecievers& recieversOf(const McSignalId& signal_id) {
+			__SignalRecievers* signal = findRecievers(signal_id.interface_tag, signal_id.index);
+			if (signal) {
+				return *signal;
+			}
+			__ConnectionState& state = connectionState();
+			std::unique_lock locker(state.mutex);
+			signal = findRecievers(signal_id.interface_tag, signal_id.index);
+			if (signal) {
+				return *signal;
+			}
+			const __SignalTable* table = state.signal_table.load(std::memory_order_relaxed);
+			auto new_table = std::make_unique<__SignalTable>(table ? *table : __SignalTable());
+			__InterfaceRecievers* found = nullptr;
+			for (auto& interface_recievers : new_table->interfaces) {
+				if (interface_recievers.interface_tag == signal_id.interface_tag) {
+					found = &interface_recievers;
+					break;
+				}
+			}
+			if (!found) {
+				found = &new_table->interfaces.emplace_back(__InterfaceRecievers{ signal_id.interface_tag, {} });
+			}
+			if (found->signals.size() <= signal_id.index) {
+				found->signals.resize(signal_id.index + 1, nullptr);
+			}
+			signal = state.signals.emplace_back(new __SignalRecievers()).get();
+			found->signals[signal_id.index] = signal;
+			state.signal_table.store(new_table.get(), std::memory_order_release);
+			state.signal_tables.push_back(std::move(new_table));
+			return *signal;
+		}
 	};
+
+	inline bool McConnection::disconnect(McDisconnectMode mode) {
+		if (m_slot.expired()) {
+			return false;
+		}
+		m_slot.reset();
+		return MultiCallBase::disconnect(m_signal, m_key, m_reciever, mode);
+	}
+
+	template<class T, class = void>
+	struct __McIsInterface : std::false_type {};
+	template<class T>
+	struct __McIsInterface<T, std::void_t<typename T::__MC_IINTERFACE>> : std::true_type {};
+
+	template<class T>
+	inline MultiCallBase* __mcInterfaceToMultiCallBase(T* obj) noexcept {
+#if MC_HAS_RTTI
+		return dynamic_cast<MultiCallBase*>(obj);
+#else
+		(void)obj;
+		return nullptr; //the sender must use MC_DECLARE_SENDER()
+#endif
+	}
+
+	template<class T>
+	inline MultiCallBase* __mcToMultiCallBase(T* obj) noexcept {
+		if constexpr (std::is_base_of_v<MultiCallBase, T>) {
+			return static_cast<MultiCallBase*>(obj);
+		}else if constexpr (__McIsInterface<T>::value) {
+			return obj->__mcMultiCallBase();
+		}else {
+			return __mcInterfaceToMultiCallBase(obj);
+		}
+	}
 };
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "multicall.h"
+
+//C++20 layer: awaiting signals from coroutines. Empty if the compiler has no coroutine support.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+	#include <coroutine>
+
+namespace multicall
+{
+	/// <summary>
+	/// Resumes the coroutine right inside McEmit(), on the emitting thread. An executor is any callable taking std::coroutine_handle<>.
+	/// </summary>
+	struct McInlineExecutor {
+		inline void operator()(std::coroutine_handle<> handle) const { handle.resume(); }
+	};
+
+	/// <summary>
+	/// Resumes the coroutine on a worker of the pool
+	/// </summary>
+	struct McPoolExecutor {
+		McThreadPool* pool;
+
+		inline void operator()(std::coroutine_handle<> handle) const { pool->submit([handle]() { handle.resume(); }); }
+	};
+
+	/// <summary>
+	/// co_await McNext(signal) suspends the coroutine until the next emit of the signal and gives its arguments as a tuple.
+	/// The awaiter lives in the coroutine frame and connects an inline callback, so the callback itself is never allocated.
+	/// It disconnects when destroyed, waiting for the emits that may still call it.
+	/// </summary>
+	template<class Executor, class ...Args>
+	class McNextAwaiter {
+	public:
+		using Value = std::tuple<std::decay_t<Args>...>;
+
+		McNextAwaiter(const McSignal<Args...>& signal, Executor executor) : m_signal(signal), m_executor(std::move(executor)) {}
+		McNextAwaiter(const McNextAwaiter&) = delete;
+		McNextAwaiter& operator = (const McNextAwaiter&) = delete;
+		inline ~McNextAwaiter() {
+			m_fired.store(true, std::memory_order_release); //a suspended coroutine is destroyed: the emits still running don't resume it
+			m_connection.disconnect(McDisconnectMode::Wait);
+		}
+
+		inline bool await_ready() const noexcept { return false; }
+
+		inline bool await_suspend(std::coroutine_handle<> handle) {
+			m_handle = handle;
+			m_connection = MultiCallBase::Connect(m_signal, McInline([this](const std::decay_t<Args>& ...values) { fire(values...); }));
+			assert(m_connection && "The sender doesn't inherit MultiCallBase!");
+			//the emit may have come already, then it didn't resume the coroutine and we don't suspend it
+			return m_state.exchange(State::Suspended, std::memory_order_acq_rel) != State::Fired;
+		}
+
+		inline Value await_resume() { return std::move(*m_value); }
+
+	private:
+		enum class State : uint8_t {
+			Connecting,
+			Suspended,
+			Fired
+		};
+
+		//Nothing may touch this after m_executor is called: the resumed coroutine may destroy the awaiter
+		inline void fire(const std::decay_t<Args>& ...values) {
+			if (m_fired.exchange(true, std::memory_order_acq_rel)) {
+				return; //an emit came before the disconnection
+			}
+			m_value.emplace(values...);
+			if (m_state.exchange(State::Fired, std::memory_order_acq_rel) == State::Suspended) {
+				m_executor(m_handle);
+			}
+		}
+
+		McSignal<Args...> m_signal;
+		Executor m_executor;
+		std::coroutine_handle<> m_handle;
+		std::optional<Value> m_value;
+		std::atomic<bool> m_fired{ false };
+		std::atomic<State> m_state{ State::Connecting };
+		McConnection m_connection;
+	};
+
+	template<class ...Args>
+	inline McNextAwaiter<McInlineExecutor, Args...> McNext(const McSignal<Args...>& signal) {
+		return McNextAwaiter<McInlineExecutor, Args...>(signal, McInlineExecutor{});
+	}
+
+	template<class Executor, class ...Args>
+	inline McNextAwaiter<Executor, Args...> McNext(const McSignal<Args...>& signal, Executor executor) {
+		return McNextAwaiter<Executor, Args...>(signal, std::move(executor));
+	}
+
+	/// <summary>
+	/// Stays connected to the signal and queues its emits, so a loop of co_await stream.next() doesn't miss the events
+	/// that come while the coroutine is busy (C++20 has no "for co_await", the loop plays its role). One coroutine at a time may await it.
+	/// </summary>
+	template<class Executor, class ...Args>
+	class McSignalStream {
+	public:
+		using Value = std::tuple<std::decay_t<Args>...>;
+
+		class NextAwaiter {
+		public:
+			inline bool await_ready() const noexcept { return false; }
+			inline bool await_suspend(std::coroutine_handle<> handle) {
+				std::lock_guard locker(m_stream->m_mutex);
+				if (!m_stream->m_events.empty()) {
+					return false;
+				}
+				m_stream->m_waiting = handle;
+				return true;
+			}
+			inline Value await_resume() {
+				std::lock_guard locker(m_stream->m_mutex);
+				Value value = std::move(m_stream->m_events.front());
+				m_stream->m_events.pop_front();
+				return value;
+			}
+
+		private:
+			friend McSignalStream;
+			explicit NextAwaiter(McSignalStream* stream) noexcept : m_stream(stream) {}
+			McSignalStream* m_stream;
+		};
+
+		explicit McSignalStream(const McSignal<Args...>& signal, Executor executor = {}) : m_executor(std::move(executor)) {
+			m_connection = MultiCallBase::Connect(signal, McInline([this](const std::decay_t<Args>& ...values) { push(values...); }));
+		}
+		McSignalStream(const McSignalStream&) = delete;
+		McSignalStream& operator = (const McSignalStream&) = delete;
+		inline ~McSignalStream() { m_connection.disconnect(McDisconnectMode::Wait); }
+
+		inline bool connected() const noexcept { return m_connection.connected(); }
+		inline NextAwaiter next() noexcept { return NextAwaiter(this); }
+
+	private:
+		inline void push(const std::decay_t<Args>& ...values) {
+			std::unique_lock locker(m_mutex);
+			m_events.emplace_back(values...);
+			const std::coroutine_handle<> waiting = std::exchange(m_waiting, nullptr);
+			locker.unlock();
+			if (waiting) {
+				m_executor(waiting);
+			}
+		}
+
+		Executor m_executor;
+		std::mutex m_mutex; //guards m_events and m_waiting
+		std::deque<Value, McAllocator<Value>> m_events;
+		std::coroutine_handle<> m_waiting;
+		McConnection m_connection;
+	};
+
+	template<class ...Args>
+	McSignalStream(const McSignal<Args...>&) -> McSignalStream<McInlineExecutor, Args...>;
+	template<class Executor, class ...Args>
+	McSignalStream(const McSignal<Args...>&, Executor) -> McSignalStream<Executor, Args...>;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "multicall.h"
+
+#if defined(__linux__)
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+	#include <unistd.h>
+	#include <cerrno>
+
+namespace multicall
+{
+	/// <summary>
+	/// Delivers queued connections onto an epoll-based event loop. Bind the recievers that live on the loop thread, add fd() to the loop
+	/// for EPOLLIN and call dispatch() when it is readable: it calls the pending events of all the bound recievers in one go.
+	/// The emitters write the eventfd only for the first event after a dispatch(), not for every event.
+	/// </summary>
+	class McDispatcher {
+	public:
+		McDispatcher() : m_notifier(std::make_shared<Notifier>()) {}
+		McDispatcher(const McDispatcher&) = delete;
+		McDispatcher& operator = (const McDispatcher&) = delete;
+
+		//The eventfd, -1 if it couldn't be created
+		inline int fd() const noexcept { return m_notifier->fd; }
+
+		//Gives the reciever a mailbox that wakes this dispatcher up. Must be called before the first queued connection to the reciever,
+		//the reciever must be destroyed on the thread that calls dispatch().
+		inline bool bind(MultiCallBase& reciever, size_t capacity = 1024, McOverflowPolicy policy = McOverflowPolicy::Block) {
+			if (m_notifier->fd < 0) {
+				return false;
+			}
+			auto mailbox = std::make_shared<McMailbox>(capacity, policy, m_notifier);
+			if (!reciever.SetupMailbox(mailbox)) {
+				return false;
+			}
+			std::lock_guard locker(m_mutex);
+			m_mailboxes.push_back(std::move(mailbox));
+			m_mailboxes_changed.store(true, std::memory_order_release);
+			return true;
+		}
+
+		//Registers fd() in the epoll instance for EPOLLIN, with this dispatcher as data.ptr
+		inline bool addTo(int epoll_fd) noexcept {
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.ptr = this;
+			return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd(), &event) == 0;
+		}
+
+		//Calls up to max_count pending events of the bound recievers on the calling thread. If it stops at max_count, fd() stays readable.
+		inline size_t dispatch(size_t max_count = SIZE_MAX) {
+			uint64_t value = 0;
+			while (read(m_notifier->fd, &value, sizeof(value)) < 0 && errno == EINTR);
+			m_notifier->pending.exchange(false, std::memory_order_acq_rel); //the events posted from now on wake the loop again
+			if (m_mailboxes_changed.exchange(false, std::memory_order_acquire)) {
+				std::lock_guard locker(m_mutex);
+				m_dispatched = m_mailboxes;
+			}
+			size_t count = 0;
+			bool has_closed = false;
+			for (const auto& mailbox : m_dispatched) {
+				if (count == max_count) {
+					break;
+				}
+				has_closed |= mailbox->isClosed(); //its events are dropped by processEvents()
+				count += mailbox->processEvents(max_count - count);
+			}
+			if (count == max_count) {
+				m_notifier->notify();
+			}
+			if (has_closed) {
+				removeClosed();
+			}
+			return count;
+		}
+
+	private:
+		struct Notifier : McMailboxNotifier {
+			const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			std::atomic<bool> pending{ false }; //fd has been written since the last dispatch()
+
+			~Notifier() override {
+				if (fd >= 0) {
+					::close(fd);
+				}
+			}
+
+			void notify() noexcept override {
+				if (!pending.exchange(true, std::memory_order_acq_rel)) {
+					const uint64_t one = 1;
+					while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR);
+				}
+			}
+		};
+
+		inline void removeClosed() {
+			auto closed = [](const std::shared_ptr<McMailbox>& mailbox) { return mailbox->isClosed(); };
+			std::lock_guard locker(m_mutex);
+			m_mailboxes.erase(std::remove_if(m_mailboxes.begin(), m_mailboxes.end(), closed), m_mailboxes.end());
+			m_dispatched = m_mailboxes;
+		}
+
+		const std::shared_ptr<Notifier> m_notifier; //shared with the mailboxes, they may outlive the dispatcher
+		std::mutex m_mutex; //guards m_mailboxes, bind() may be called from any thread
+		std::vector<std::shared_ptr<McMailbox>> m_mailboxes;
+		std::atomic<bool> m_mailboxes_changed{ false };
+		std::vector<std::shared_ptr<McMailbox>> m_dispatched; //copy of m_mailboxes for the thread of dispatch(), so it calls the recievers without the lock
+	};
+};
+
+#endif
@@ -0,0 +1,423 @@
+#pragma once
+
+#include "multicall.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+
+namespace multicall
+{
+	/// <summary>
+	/// Record of an emit in McEventLog: the arguments copied one after another, without padding
+	/// </summary>
+	template<class ...Args>
+	struct McRecordCodec {
+		static_assert((std::is_trivially_copyable_v<Args> && ...), "Only trivially copyable arguments can be recorded");
+
+		using Values = std::tuple<std::decay_t<Args>...>;
+
+		static constexpr size_t size = (size_t(0) + ... + sizeof(Args));
+		//Tells the logs of different signatures apart: the sizes of the arguments
+		static constexpr uint64_t signature = []() {
+			const uint64_t values[] = { sizeof(Args)..., sizeof...(Args) };
+			uint64_t hash = 14695981039346656037ull; //FNV-1a
+			for (uint64_t value : values) {
+				hash = (hash ^ value) * 1099511628211ull;
+			}
+			return hash;
+		}();
+
+		static inline void encode(uint8_t* data, const std::remove_reference_t<Args>& ...args) noexcept {
+			((memcpy(data, &args, sizeof(args)), data += sizeof(args)), ...);
+		}
+
+		static inline Values decode(const uint8_t* data) noexcept {
+			static_assert(std::is_default_constructible_v<Values>, "Only default constructible arguments can be replayed");
+			Values values;
+			std::apply([&data](auto& ...value) { ((memcpy(&value, data, sizeof(value)), data += sizeof(value)), ...); }, values);
+			return values;
+		}
+	};
+
+	/// <summary>
+	/// Append-only log of fixed-size records in a file: a header page, then segments of segment_size bytes, each of them is
+	/// the number of its records and the records. A record is the timestamp in nanoseconds since the log was created and the payload.
+	/// </summary>
+	struct McEventLog {
+		static constexpr uint64_t magic = 0x4d434c4f47000001ull; //"MCLOG" and the version of the format
+
+		struct Header {
+			uint64_t magic;
+			uint64_t signature;
+			uint64_t payload_size;
+			uint64_t header_size;
+			uint64_t segment_size;
+		};
+
+		static inline size_t recordSize(size_t payload_size) noexcept { return sizeof(uint64_t) + payload_size; }
+		static inline size_t pageSize() noexcept { return size_t(sysconf(_SC_PAGESIZE)); }
+	};
+
+	/// <summary>
+	/// Writer of McEventLog that doesn't block the emitters on the file or on each other: an emitter reserves its record in the
+	/// mapped segment with a compare-exchange of the cursor and copies it there. A background thread unmaps the filled segments
+	/// and maps the next one ahead of time. If the next segment isn't mapped yet when one is filled, the records are dropped
+	/// (and counted) until it is. The timestamps of the records are in the order of the records.
+	/// </summary>
+	class McEventLogWriter {
+	public:
+		McEventLogWriter(const std::string& path, uint64_t signature, size_t payload_size, size_t segment_size)
+			: m_record_size(McEventLog::recordSize(payload_size)), m_header_size(McEventLog::pageSize()) {
+			const size_t page = McEventLog::pageSize();
+			m_segment_size = std::min<size_t>(std::max(segment_size, sizeof(uint64_t) + m_record_size), max_segment_size);
+			m_segment_size = (m_segment_size + page - 1) / page * page;
+			m_fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644);
+			if (m_fd < 0) {
+				return;
+			}
+			uint8_t* header = mapRegion(0, m_header_size);
+			uint8_t* active = header ? mapSegment(0) : nullptr;
+			m_next = active ? mapSegment(1) : nullptr;
+			if (!m_next) {
+				if (active) {
+					munmap(active, m_segment_size);
+				}
+				if (header) {
+					munmap(header, m_header_size);
+				}
+				::close(m_fd);
+				m_fd = -1;
+				return;
+			}
+			*reinterpret_cast<McEventLog::Header*>(header) = McEventLog::Header{ McEventLog::magic, signature, payload_size, m_header_size, m_segment_size };
+			munmap(header, m_header_size);
+			m_segments[0].data = active;
+			m_mapped_segments = 2;
+			m_start = std::chrono::steady_clock::now();
+			m_cursor.store(sizeof(uint64_t), std::memory_order_release);
+			m_thread = std::thread(&McEventLogWriter::flusherThread, this);
+		}
+		McEventLogWriter(const McEventLogWriter&) = delete;
+		McEventLogWriter& operator = (const McEventLogWriter&) = delete;
+		inline ~McEventLogWriter() { close(); }
+
+		//False if the file couldn't be created, and once it is closed
+		inline bool isOpen() const noexcept { return !(m_cursor.load(std::memory_order_acquire) & closed); }
+		inline uint64_t recorded() const noexcept { return m_recorded.load(std::memory_order_relaxed); }
+		inline uint64_t dropped() const noexcept { return m_dropped.load(std::memory_order_relaxed); }
+
+		//encode(payload) writes the payload of the record. Returns false if the record is dropped.
+		template<class Encode>
+		inline bool append(Encode&& encode) noexcept {
+			uint64_t cursor = m_cursor.load(std::memory_order_acquire);
+			uint64_t timestamp = 0;
+			while (true) {
+				if (cursor & closed) {
+					m_dropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				if ((cursor & used_mask) + m_record_size > m_segment_size) {
+					if (!nextSegment(cursor)) {
+						m_dropped.fetch_add(1, std::memory_order_relaxed);
+						return false;
+					}
+					cursor = m_cursor.load(std::memory_order_acquire);
+					continue;
+				}
+				//Read before every attempt: whoever reserves after us read the clock after our reservation
+				timestamp = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+				if (m_cursor.compare_exchange_weak(cursor, cursor + m_record_size, std::memory_order_acquire, std::memory_order_acquire)) {
+					break;
+				}
+			}
+			Segment& segment = m_segments[(cursor >> segment_shift) % ring_size];
+			uint8_t* record = segment.data + (cursor & used_mask);
+			memcpy(record, &timestamp, sizeof(timestamp));
+			encode(record + sizeof(timestamp));
+			segment.committed.fetch_add(1, std::memory_order_release); //the background thread unmaps the segment once all of them are in
+			m_recorded.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		//Writes out what is recorded and closes the file. The records appended after it are dropped.
+		inline void close() {
+			{
+				std::lock_guard locker(m_mutex);
+				if (m_closing) {
+					return;
+				}
+				m_closing = true;
+				m_last_cursor = m_cursor.fetch_or(closed, std::memory_order_acq_rel);
+			}
+			m_wakeup.notify_one();
+			if (m_thread.joinable()) {
+				m_thread.join();
+			}
+		}
+
+	private:
+		//The cursor is the number of the active segment and the bytes of it reserved so far
+		static constexpr int segment_shift = 32;
+		static constexpr uint64_t used_mask = (uint64_t(1) << segment_shift) - 1;
+		static constexpr uint64_t closed = uint64_t(1) << 63;
+		static constexpr size_t max_segment_size = size_t(1) << 30;
+		static constexpr size_t ring_size = 4; //the retired, the active and the next segment never share a slot
+
+		struct Segment {
+			uint8_t* data = nullptr;
+			std::atomic<uint64_t> committed{ 0 }; //records copied into it
+		};
+
+		//Grows the file to the end of the region. The pages are faulted in here, on the background thread, rather than by the emitters.
+		inline uint8_t* mapRegion(size_t offset, size_t size) noexcept {
+			if (ftruncate(m_fd, off_t(offset + size)) != 0) {
+				return nullptr;
+			}
+	#if defined(MAP_POPULATE)
+			const int flags = MAP_SHARED | MAP_POPULATE;
+	#else
+			const int flags = MAP_SHARED;
+	#endif
+			void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, m_fd, off_t(offset));
+			return memory == MAP_FAILED ? nullptr : static_cast<uint8_t*>(memory);
+		}
+		inline uint8_t* mapSegment(size_t index) noexcept { return mapRegion(m_header_size + index * m_segment_size, m_segment_size); }
+
+		//On the background thread: waits for the emitters still copying into the segment, writes its record count and unmaps it
+		inline void finishSegment(uint64_t cursor) noexcept {
+			Segment& segment = m_segments[((cursor & ~closed) >> segment_shift) % ring_size];
+			const uint64_t count = ((cursor & used_mask) - sizeof(uint64_t)) / m_record_size;
+			while (segment.committed.load(std::memory_order_acquire) < count) {
+				std::this_thread::yield();
+			}
+			memcpy(segment.data, &count, sizeof(count));
+			munmap(segment.data, m_segment_size);
+			segment.data = nullptr;
+		}
+
+		//The segment of full_cursor is full: switches to the one mapped ahead, the background thread retires the full one.
+		//Only this takes the lock on the emitting side, once per segment.
+		inline bool nextSegment(uint64_t full_cursor) noexcept {
+			std::lock_guard locker(m_mutex);
+			if (m_cursor.load(std::memory_order_relaxed) != full_cursor) {
+				return true; //switched (or closed) by someone else
+			}
+			if (!m_next || m_retired) {
+				return false;
+			}
+			const uint64_t number = (full_cursor >> segment_shift) + 1;
+			Segment& segment = m_segments[number % ring_size];
+			segment.data = std::exchange(m_next, nullptr);
+			segment.committed.store(0, std::memory_order_relaxed);
+			m_cursor.store((number << segment_shift) | sizeof(uint64_t), std::memory_order_release); //the full segment takes no reservation, so nothing is lost
+			m_retired = full_cursor;
+			m_wakeup.notify_one();
+			return true;
+		}
+
+		void flusherThread() {
+			std::unique_lock locker(m_mutex);
+			while (true) {
+				m_wakeup.wait(locker, [this]() { return m_closing || m_retired; });
+				const uint64_t retired = std::exchange(m_retired, 0);
+				const bool closing = m_closing;
+				locker.unlock();
+				if (retired) {
+					finishSegment(retired); //the kernel writes the pages out
+				}
+				if (closing) {
+					finishSegment(m_last_cursor);
+					locker.lock();
+					uint8_t* next = std::exchange(m_next, nullptr);
+					locker.unlock();
+					if (next) {
+						munmap(next, m_segment_size);
+					}
+					if (ftruncate(m_fd, off_t(m_header_size + (m_mapped_segments - (next ? 1 : 0)) * m_segment_size)) != 0) {
+						//the log is still readable, it just ends with an empty segment
+					}
+					::close(m_fd);
+					return;
+				}
+				uint8_t* next = retired ? mapSegment(m_mapped_segments) : nullptr;
+				locker.lock();
+				if (next) {
+					m_next = next;
+					++m_mapped_segments;
+				}
+			}
+		}
+
+		const size_t m_record_size;
+		const size_t m_header_size;
+		size_t m_segment_size = 0;
+		int m_fd = -1;
+		std::chrono::steady_clock::time_point m_start;
+		std::atomic<uint64_t> m_cursor{ closed }; //where the next record goes, see segment_shift. closed until the file is open and after close()
+		Segment m_segments[ring_size]; //by the number of the segment
+		std::mutex m_mutex; //guards the switch of segments and the hand-over to the background thread, the records are copied without it
+		std::condition_variable m_wakeup;
+		uint8_t* m_next = nullptr; //mapped ahead by the background thread
+		uint64_t m_retired = 0; //the last cursor of a full segment, for the background thread to unmap
+		uint64_t m_last_cursor = 0; //of the active segment when the writer is closed
+		size_t m_mapped_segments = 0; //the file has this many segments, written by the background thread
+		bool m_closing = false;
+		std::atomic<uint64_t> m_recorded{ 0 };
+		std::atomic<uint64_t> m_dropped{ 0 };
+		std::thread m_thread;
+	};
+
+	/// <summary>
+	/// Reads a McEventLog written for the signature
+	/// </summary>
+	class McEventLogReader {
+	public:
+		McEventLogReader(const std::string& path, uint64_t signature, size_t payload_size) {
+			const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0) {
+				return;
+			}
+			struct stat info{};
+			if (fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(McEventLog::Header)) {
+				void* memory = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+				if (memory != MAP_FAILED) {
+					m_data = static_cast<const uint8_t*>(memory);
+					m_size = size_t(info.st_size);
+				}
+			}
+			::close(fd);
+			if (m_data) {
+				memcpy(&m_header, m_data, sizeof(m_header));
+				if (m_header.magic != McEventLog::magic || m_header.signature != signature || m_header.payload_size != payload_size
+					|| m_header.segment_size == 0 || m_header.header_size > m_size) {
+					munmap(const_cast<uint8_t*>(m_data), m_size);
+					m_data = nullptr;
+				}
+			}
+		}
+		McEventLogReader(const McEventLogReader&) = delete;
+		McEventLogReader& operator = (const McEventLogReader&) = delete;
+		inline ~McEventLogReader() {
+			if (m_data) {
+				munmap(const_cast<uint8_t*>(m_data), m_size);
+			}
+		}
+
+		inline bool isOpen() const noexcept { return m_data != nullptr; }
+
+		//Calls function(timestamp_ns, payload) for every record in the order of recording. Stops if function returns false.
+		template<class F>
+		inline size_t forEach(F&& function) const {
+			if (!m_data) {
+				return 0;
+			}
+			const size_t record_size = McEventLog::recordSize(size_t(m_header.payload_size));
+			size_t count = 0;
+			for (size_t offset = size_t(m_header.header_size); offset + m_header.segment_size <= m_size; offset += size_t(m_header.segment_size)) {
+				uint64_t records = 0;
+				memcpy(&records, m_data + offset, sizeof(records));
+				records = std::min<uint64_t>(records, (m_header.segment_size - sizeof(uint64_t)) / record_size);
+				const uint8_t* record = m_data + offset + sizeof(uint64_t);
+				for (uint64_t i = 0; i < records; ++i, record += record_size) {
+					uint64_t timestamp = 0;
+					memcpy(&timestamp, record, sizeof(timestamp));
+					++count;
+					if (!function(timestamp, record + sizeof(timestamp))) {
+						return count;
+					}
+				}
+			}
+			return count;
+		}
+
+	private:
+		const uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+		McEventLog::Header m_header{};
+	};
+
+	/// <summary>
+	/// Records every emit of a signal into a McEventLog file, for McReplayer. The arguments must be trivially copyable.
+	/// </summary>
+	template<class ...Args>
+	class McRecorder {
+	public:
+		using Codec = McRecordCodec<Args...>;
+
+		McRecorder(const McSignal<Args...>& signal, const std::string& path, size_t segment_size = 1 << 20)
+			: m_log(path, Codec::signature, Codec::size, segment_size) {
+			if (m_log.isOpen()) {
+				m_connection = MultiCallBase::Connect(signal, McInline([this](const std::decay_t<Args>& ...args) { record(args...); }));
+			}
+		}
+		McRecorder(const McRecorder&) = delete;
+		McRecorder& operator = (const McRecorder&) = delete;
+		inline ~McRecorder() { close(); }
+
+		//False if the file couldn't be created
+		inline bool isOpen() const noexcept { return m_log.isOpen() && m_connection.connected(); }
+		inline uint64_t recorded() const noexcept { return m_log.recorded(); }
+		inline uint64_t dropped() const noexcept { return m_log.dropped(); }
+
+		inline bool record(const std::decay_t<Args>& ...args) noexcept {
+			return m_log.append([&](uint8_t* payload) { Codec::encode(payload, args...); });
+		}
+
+		//Stops the recording and writes the file out
+		inline void close() {
+			m_connection.disconnect(McDisconnectMode::Wait);
+			m_log.close();
+		}
+
+	private:
+		McEventLogWriter m_log;
+		McConnection m_connection;
+	};
+
+	enum class McReplayTiming {
+		Original, //the emits are as far apart as they were recorded
+		FullSpeed //one after another
+	};
+
+	/// <summary>
+	/// Re-emits a log of McRecorder: connect to signal() as to any other sender, then call replay() on the thread the emits must come from
+	/// </summary>
+	template<class Interface, class ...Args>
+	class McReplayer : public Interface, public MultiCallBase {
+	public:
+		MC_DECLARE_SENDER()
+
+		using Codec = McRecordCodec<Args...>;
+
+		template<size_t _Index>
+		McReplayer(const std::string& path, McSignalSlot<_Index>(Interface::* signal)(Args...)) : m_signal(this, signal), m_log(path, Codec::signature, Codec::size) {}
+		~McReplayer() {
+			DisconnectFromAll(McDisconnectMode::Wait);
+		}
+
+		inline const McSignal<Args...>& signal() const noexcept { return m_signal; }
+		//False if there is no such file or it's recorded for another signature
+		inline bool isOpen() const noexcept { return m_log.isOpen(); }
+
+		//Emits the whole log, returns the number of emits
+		inline size_t replay(McReplayTiming timing = McReplayTiming::Original) {
+			const auto start = std::chrono::steady_clock::now();
+			return m_log.forEach([&](uint64_t timestamp, const uint8_t* payload) {
+				if (timing == McReplayTiming::Original) {
+					std::this_thread::sleep_until(start + std::chrono::nanoseconds(timestamp));
+				}
+				std::apply([this](const std::decay_t<Args>& ...args) { McEmit(m_signal, args...); }, Codec::decode(payload));
+				return true;
+			});
+		}
+
+	private:
+		const McSignal<Args...> m_signal;
+		McEventLogReader m_log;
+	};
+};
+
+#endif
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "multicall.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <array>
+
+namespace multicall
+{
+	/// <summary>
+	/// Where the arguments of a signal lie in a record of McShmRing: every argument is copied as is, at its natural alignment.
+	/// </summary>
+	template<class ...Args>
+	struct McShmLayout {
+		static constexpr size_t count = sizeof...(Args);
+
+		//offsets[i] is the offset of the argument i, offsets[count] is the size of the record
+		static constexpr std::array<size_t, count + 1> offsets = []() {
+			const size_t sizes[] = { sizeof(Args)..., 0 };
+			const size_t alignments[] = { alignof(Args)..., 1 };
+			std::array<size_t, count + 1> result{};
+			size_t offset = 0;
+			for (size_t i = 0; i < count; ++i) {
+				offset = (offset + alignments[i] - 1) / alignments[i] * alignments[i];
+				result[i] = offset;
+				offset += sizes[i];
+			}
+			result[count] = offset;
+			return result;
+		}();
+		static constexpr size_t size = offsets[count];
+		static constexpr size_t alignment = std::max({ alignof(uint64_t), alignof(Args)... });
+
+		//Tells the processes with different signatures apart: the sizes and the alignments of the arguments
+		static constexpr uint64_t signature = []() {
+			const uint64_t values[] = { sizeof(Args)..., alignof(Args)..., count };
+			uint64_t hash = 14695981039346656037ull; //FNV-1a
+			for (uint64_t value : values) {
+				hash = (hash ^ value) * 1099511628211ull;
+			}
+			return hash;
+		}();
+	};
+
+	/// <summary>
+	/// Single-producer/multi-consumer ring of the records of a signal in POSIX shared memory. The producer never waits for the consumers:
+	/// every slot is a seqlock with the sequence number of its record, so a consumer that is lapped sees it and counts the lost records.
+	/// </summary>
+	template<class ...Args>
+	class McShmRing {
+	public:
+		using Layout = McShmLayout<Args...>;
+
+		static_assert((std::is_trivially_copyable_v<Args> && ...), "Only trivially copyable arguments can be shared between processes");
+		static_assert(std::atomic<uint64_t>::is_always_lock_free, "The ring needs lock-free 64-bit atomics");
+
+		McShmRing(const McShmRing&) = delete;
+		McShmRing& operator = (const McShmRing&) = delete;
+		inline ~McShmRing() {
+			if (m_header) {
+				munmap(m_header, m_mapped_size);
+			}
+			if (m_owner) {
+				shm_unlink(m_name.c_str());
+			}
+		}
+
+		//Creates the ring for the producer, replacing the one with the same name. capacity is rounded up to a power of two.
+		static inline std::unique_ptr<McShmRing> create(const std::string& name, size_t capacity) {
+			capacity = std::max<size_t>(capacity, 2);
+			size_t rounded = 1;
+			while (rounded < capacity) {
+				rounded <<= 1;
+			}
+			shm_unlink(name.c_str());
+			const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			if (fd < 0) {
+				return nullptr;
+			}
+			const size_t mapped_size = sizeof(Header) + rounded * slotSize();
+			void* memory = ftruncate(fd, off_t(mapped_size)) == 0 ? mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+			::close(fd);
+			if (memory == MAP_FAILED) {
+				shm_unlink(name.c_str());
+				return nullptr;
+			}
+			std::unique_ptr<McShmRing> ring(new McShmRing(name, true));
+			ring->map(memory, mapped_size);
+			Header* header = new(memory) Header();
+			header->signature = Layout::signature;
+			header->capacity = rounded;
+			header->slot_size = slotSize();
+			for (size_t i = 0; i < rounded; ++i) {
+				new(ring->slot(i)) std::atomic<uint64_t>(0);
+			}
+			header->magic.store(magic, std::memory_order_release); //the header is complete
+			return ring;
+		}
+
+		//Opens the ring of a producer for reading. Null if there is none yet or it's made for another signature.
+		static inline std::unique_ptr<McShmRing> open(const std::string& name) {
+			const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+			if (fd < 0) {
+				return nullptr;
+			}
+			struct stat info{};
+			void* memory = fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(Header) ? mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+			::close(fd);
+			if (memory == MAP_FAILED) {
+				return nullptr;
+			}
+			std::unique_ptr<McShmRing> ring(new McShmRing(name, false));
+			ring->map(memory, size_t(info.st_size));
+			const Header* header = ring->m_header;
+			if (header->magic.load(std::memory_order_acquire) != magic || header->signature != Layout::signature || header->slot_size != slotSize()
+				|| sizeof(Header) + header->capacity * slotSize() > ring->m_mapped_size) {
+				return nullptr;
+			}
+			return ring;
+		}
+
+		inline size_t capacity() const noexcept { return size_t(m_header->capacity); }
+		//Sequence number of the next record
+		inline uint64_t head() const noexcept { return m_header->head.load(std::memory_order_acquire); }
+
+		//Producer only, from one thread at a time
+		inline void write(const std::remove_reference_t<Args>& ...args) noexcept {
+			const uint64_t sequence = m_header->head.load(std::memory_order_relaxed);
+			std::atomic<uint64_t>& slot_sequence = *slot(sequence);
+			slot_sequence.store(sequence * 2 + 1, std::memory_order_relaxed); //odd while the record is written
+			std::atomic_thread_fence(std::memory_order_release);
+			writeArgs(payload(sequence), std::index_sequence_for<Args...>{}, args...);
+			slot_sequence.store(sequence * 2 + 2, std::memory_order_release);
+			m_header->head.store(sequence + 1, std::memory_order_release);
+		}
+
+		//Copies the record into buffer (Layout::size bytes). Returns false if the record has been overwritten (or isn't written yet).
+		inline bool read(uint64_t sequence, uint8_t* buffer) const noexcept {
+			const std::atomic<uint64_t>& slot_sequence = *slot(sequence);
+			const uint64_t before = slot_sequence.load(std::memory_order_acquire);
+			if (before != sequence * 2 + 2) {
+				return false;
+			}
+			memcpy(buffer, payload(sequence), Layout::size);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return slot_sequence.load(std::memory_order_relaxed) == before;
+		}
+
+		//Calls function(arguments...) with the arguments of a record copied by read()
+		template<class F>
+		static inline void apply(const uint8_t* buffer, F&& function) {
+			applyImpl(buffer, std::index_sequence_for<Args...>{}, std::forward<F>(function));
+		}
+
+	private:
+		static constexpr uint64_t magic = 0x4d43524e47000001ull; //"MCRNG" and the version of the layout
+
+		struct Header {
+			std::atomic<uint64_t> magic{ 0 };
+			uint64_t signature = 0;
+			uint64_t capacity = 0;
+			uint64_t slot_size = 0;
+			alignas(64) std::atomic<uint64_t> head{ 0 }; //written by the producer only, on a cache line of its own
+		};
+
+		//A slot is the sequence word and the record after it, rounded to cache lines so neighbour slots don't share one
+		static constexpr size_t payloadOffset() noexcept { return (sizeof(uint64_t) + Layout::alignment - 1) / Layout::alignment * Layout::alignment; }
+		static constexpr size_t slotSize() noexcept { return (payloadOffset() + Layout::size + 63) / 64 * 64; }
+
+		McShmRing(const std::string& name, bool owner) : m_name(name), m_owner(owner) {}
+
+		inline void map(void* memory, size_t size) noexcept {
+			m_header = static_cast<Header*>(memory);
+			m_mapped_size = size;
+			m_slots = static_cast<uint8_t*>(memory) + sizeof(Header);
+		}
+
+		inline std::atomic<uint64_t>* slot(uint64_t sequence) const noexcept {
+			return reinterpret_cast<std::atomic<uint64_t>*>(m_slots + (sequence & (m_header->capacity - 1)) * slotSize());
+		}
+		inline uint8_t* payload(uint64_t sequence) const noexcept {
+			return reinterpret_cast<uint8_t*>(slot(sequence)) + payloadOffset();
+		}
+
+		template<size_t ...I>
+		static inline void writeArgs(uint8_t* payload, std::index_sequence<I...>, const std::remove_reference_t<Args>& ...args) noexcept {
+			(memcpy(payload + Layout::offsets[I], &args, sizeof(args)), ...);
+		}
+
+		template<size_t ...I, class F>
+		static inline void applyImpl(const uint8_t* buffer, std::index_sequence<I...>, F&& function) {
+			function(*std::launder(reinterpret_cast<const std::decay_t<Args>*>(buffer + Layout::offsets[I]))...);
+		}
+
+		std::string m_name;
+		bool m_owner; //created the ring, unlinks the name when destroyed
+		Header* m_header = nullptr;
+		size_t m_mapped_size = 0;
+		uint8_t* m_slots = nullptr;
+	};
+
+	/// <summary>
+	/// Mirrors a signal into shared memory for the McShmProxy objects of other processes. The arguments must be trivially copyable,
+	/// they are copied into the ring as they are. Emits of the signal from several threads are serialized by a lock.
+	/// </summary>
+	template<class ...Args>
+	class McShmPublisher {
+	public:
+		McShmPublisher(const McSignal<Args...>& signal, const std::string& name, size_t capacity = 4096) : m_ring(McShmRing<Args...>::create(name, capacity)) {
+			if (m_ring) {
+				m_connection = MultiCallBase::Connect(signal, McInline([this](const std::decay_t<Args>& ...args) { publish(args...); }));
+			}
+		}
+		McShmPublisher(const McShmPublisher&) = delete;
+		McShmPublisher& operator = (const McShmPublisher&) = delete;
+		inline ~McShmPublisher() { m_connection.disconnect(McDisconnectMode::Wait); }
+
+		//False if the shared memory couldn't be created
+		inline bool isOpen() const noexcept { return m_connection.connected(); }
+		inline uint64_t published() const noexcept { return m_ring ? m_ring->head() : 0; }
+
+		inline void publish(const std::decay_t<Args>& ...args) {
+			std::lock_guard locker(m_mutex);
+			m_ring->write(args...);
+		}
+
+	private:
+		std::unique_ptr<McShmRing<Args...>> m_ring;
+		std::mutex m_mutex;
+		McConnection m_connection;
+	};
+
+	/// <summary>
+	/// Re-emits in this process the signal that a McShmPublisher of another process mirrors: connect to signal() as to any other sender.
+	/// poll() emits the records published since the previous poll() on the calling thread. A consumer that falls more than
+	/// the capacity of the ring behind loses the oldest records, overruns() counts them.
+	/// </summary>
+	template<class Interface, class ...Args>
+	class McShmProxy : public Interface, public MultiCallBase {
+	public:
+		MC_DECLARE_SENDER()
+
+		template<size_t _Index>
+		McShmProxy(const std::string& name, McSignalSlot<_Index>(Interface::* signal)(Args...)) : m_signal(this, signal), m_name(name) {
+			open();
+		}
+		~McShmProxy() {
+			DisconnectFromAll(McDisconnectMode::Wait);
+		}
+
+		inline const McSignal<Args...>& signal() const noexcept { return m_signal; }
+		//Attaches to the ring if it wasn't there yet, e.g. the producer has started after this object
+		inline bool open() {
+			if (!m_ring) {
+				m_ring = McShmRing<Args...>::open(m_name);
+				if (m_ring) {
+					m_next = m_ring->head(); //only the records published from now on
+				}
+			}
+			return bool(m_ring);
+		}
+		inline bool isOpen() const noexcept { return bool(m_ring); }
+		inline uint64_t overruns() const noexcept { return m_overruns; }
+
+		//Emits up to max_count new records, returns how many
+		inline size_t poll(size_t max_count = SIZE_MAX) {
+			if (!m_ring) {
+				return 0;
+			}
+			alignas(McShmLayout<Args...>::alignment) uint8_t buffer[std::max<size_t>(McShmLayout<Args...>::size, 1)];
+			size_t count = 0;
+			uint64_t head = m_ring->head();
+			while (m_next != head && count < max_count) {
+				if (head - m_next > m_ring->capacity()) {
+					m_overruns += head - m_next - m_ring->capacity(); //overwritten already, go to the oldest record of the ring
+					m_next = head - m_ring->capacity();
+				}
+				if (!m_ring->read(m_next, buffer)) {
+					++m_overruns; //overwritten while it was read, the producer has lapped us
+					++m_next;
+					head = m_ring->head();
+					continue;
+				}
+				++m_next;
+				McShmRing<Args...>::apply(buffer, [this](const std::decay_t<Args>& ...args) { McEmit(m_signal, args...); });
+				++count;
+			}
+			return count;
+		}
+
+	private:
+		const McSignal<Args...> m_signal;
+		const std::string m_name;
+		std::unique_ptr<McShmRing<Args...>> m_ring;
+		uint64_t m_next = 0; //sequence number of the next record to emit
+		uint64_t m_overruns = 0;
+	};
+};
+
+#endif
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "multicall.h"
+#include <ostream>
+
+//Export of the events recorded by McTracer (build with MC_ENABLE_TRACING=1): Chrome trace JSON for chrome://tracing and ui.perfetto.dev,
+//or Perfetto protobuf. Every emit and every subscriber call is a slice on the track of the thread it ran on, the calls are nested in their emit.
+namespace multicall
+{
+	namespace __trace
+	{
+		inline std::string pointer(const void* ptr) {
+			char text[2 + sizeof(void*) * 2 + 1];
+			snprintf(text, sizeof(text), "0x%llx", static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(ptr)));
+			return text;
+		}
+
+		inline std::string sliceName(const McTraceEvent& event) {
+			return (event.kind == McTraceEvent::Kind::EmitBegin ? "emit #" : "call #") + std::to_string(event.index);
+		}
+
+		inline std::string jsonString(const std::string& text) {
+			std::string result = "\"";
+			for (const char c : text) {
+				if (c == '"' || c == '\\') {
+					result += '\\';
+					result += c;
+				}else if (static_cast<unsigned char>(c) < 0x20) {
+					char escaped[8];
+					snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					result += escaped;
+				}else {
+					result += c;
+				}
+			}
+			return result + "\"";
+		}
+
+		//The first timestamp of the trace, the exported times start from it
+		inline uint64_t origin(const std::vector<McTraceThread>& threads) noexcept {
+			uint64_t result = UINT64_MAX;
+			for (const McTraceThread& thread : threads) {
+				if (!thread.events.empty()) {
+					result = std::min(result, thread.events.front().timestamp_ns);
+				}
+			}
+			return result == UINT64_MAX ? 0 : result;
+		}
+
+		/// <summary>
+		/// Appends protobuf fields to a buffer. Nested messages are written into a buffer of their own and appended with bytes().
+		/// </summary>
+		class ProtoWriter {
+		public:
+			inline void varint(uint32_t field, uint64_t value) {
+				raw((uint64_t(field) << 3) | 0);
+				raw(value);
+			}
+			inline void bytes(uint32_t field, const std::string& value) {
+				raw((uint64_t(field) << 3) | 2);
+				raw(value.size());
+				m_data += value;
+			}
+			inline const std::string& data() const noexcept { return m_data; }
+
+		private:
+			inline void raw(uint64_t value) {
+				while (value >= 0x80) {
+					m_data += char(uint8_t(value) | 0x80);
+					value >>= 7;
+				}
+				m_data += char(value);
+			}
+
+			std::string m_data;
+		};
+	};
+
+	/// <summary>
+	/// Writes the Chrome trace event format: begin/end ("B"/"E") events in microseconds, tid is McTraceThread::index.
+	/// The sender, the interface and the reciever are the args of the slices.
+	/// </summary>
+	inline void McWriteChromeTrace(std::ostream& out, const std::vector<McTraceThread>& threads) {
+		const uint64_t origin = __trace::origin(threads);
+		out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+		bool first = true;
+		auto separate = [&out, &first]() {
+			out << (first ? "  " : ",\n  ");
+			first = false;
+		};
+		char timestamp[32];
+		for (const McTraceThread& thread : threads) {
+			separate();
+			out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread.index << ", \"args\": {\"name\": "
+				<< __trace::jsonString(thread.name.empty() ? "thread " + std::to_string(thread.index) : thread.name) << "}}";
+			for (const McTraceEvent& event : thread.events) {
+				separate();
+				snprintf(timestamp, sizeof(timestamp), "%.3f", double(event.timestamp_ns - origin) / 1000.0);
+				if (!event.isBegin()) {
+					out << "{\"ph\": \"E\", \"pid\": 1, \"tid\": " << thread.index << ", \"ts\": " << timestamp << "}";
+					continue;
+				}
+				out << "{\"name\": \"" << __trace::sliceName(event) << "\", \"cat\": \"multicall\", \"ph\": \"B\", \"pid\": 1, \"tid\": " << thread.index
+					<< ", \"ts\": " << timestamp << ", \"args\": {\"sender\": \"" << __trace::pointer(event.sender)
+					<< "\", \"interface\": \"" << __trace::pointer(event.interface_tag) << "\", \"signal\": " << event.index;
+				if (event.kind == McTraceEvent::Kind::CallBegin) {
+					out << ", \"reciever\": \"" << __trace::pointer(event.reciever) << "\", \"callable\": \"" << __trace::pointer(event.callable) << "\"";
+				}
+				out << "}}";
+			}
+			if (thread.dropped) {
+				separate();
+				out << "{\"name\": \"dropped_events\", \"ph\": \"C\", \"pid\": 1, \"tid\": " << thread.index << ", \"ts\": 0, \"args\": {\"dropped\": " << thread.dropped << "}}";
+			}
+		}
+		out << "\n]}\n";
+	}
+
+	/// <summary>
+	/// Writes a Perfetto trace (perfetto.protos.Trace): a TrackDescriptor per thread and TrackEvent slices on it.
+	/// The timestamps are of steady_clock, the viewer shows them as they are.
+	/// </summary>
+	inline void McWritePerfettoTrace(std::ostream& out, const std::vector<McTraceThread>& threads) {
+		enum : uint32_t {
+			TracePacket = 1, //Trace.packet
+			TracePacketTimestamp = 8,
+			TracePacketSequenceId = 10,
+			TracePacketTrackEvent = 11,
+			TracePacketTrackDescriptor = 60,
+			TrackDescriptorUuid = 1,
+			TrackDescriptorThread = 4,
+			ThreadDescriptorPid = 1,
+			ThreadDescriptorTid = 2,
+			ThreadDescriptorName = 5,
+			TrackEventAnnotations = 4,
+			TrackEventType = 9,
+			TrackEventTrackUuid = 11,
+			TrackEventCategories = 22,
+			TrackEventName = 23,
+			AnnotationUint = 3,
+			AnnotationPointer = 7,
+			AnnotationName = 10,
+			SliceBegin = 1,
+			SliceEnd = 2
+		};
+		static const uint64_t track_base = 0x6d63000000000000ull; //uuids of the thread tracks, unlikely to collide with the tracks of other producers
+		auto writePacket = [&out](const __trace::ProtoWriter& packet) {
+			__trace::ProtoWriter trace;
+			trace.bytes(TracePacket, packet.data());
+			out.write(trace.data().data(), std::streamsize(trace.data().size()));
+		};
+		auto annotation = [](uint32_t type, const char* name, uint64_t value) {
+			__trace::ProtoWriter result;
+			result.bytes(AnnotationName, name);
+			result.varint(type, value);
+			return result.data();
+		};
+		for (const McTraceThread& thread : threads) {
+			const uint64_t track = track_base + thread.index;
+			__trace::ProtoWriter thread_descriptor;
+			thread_descriptor.varint(ThreadDescriptorPid, 1);
+			thread_descriptor.varint(ThreadDescriptorTid, thread.index);
+			thread_descriptor.bytes(ThreadDescriptorName, thread.name.empty() ? "thread " + std::to_string(thread.index) : thread.name);
+			__trace::ProtoWriter track_descriptor;
+			track_descriptor.varint(TrackDescriptorUuid, track);
+			track_descriptor.bytes(TrackDescriptorThread, thread_descriptor.data());
+			__trace::ProtoWriter descriptor_packet;
+			descriptor_packet.varint(TracePacketSequenceId, thread.index);
+			descriptor_packet.bytes(TracePacketTrackDescriptor, track_descriptor.data());
+			writePacket(descriptor_packet);
+
+			for (const McTraceEvent& event : thread.events) {
+				__trace::ProtoWriter track_event;
+				track_event.varint(TrackEventType, event.isBegin() ? SliceBegin : SliceEnd);
+				track_event.varint(TrackEventTrackUuid, track);
+				if (event.isBegin()) {
+					track_event.bytes(TrackEventCategories, "multicall");
+					track_event.bytes(TrackEventName, __trace::sliceName(event));
+					track_event.bytes(TrackEventAnnotations, annotation(AnnotationPointer, "sender", reinterpret_cast<uintptr_t>(event.sender)));
+					track_event.bytes(TrackEventAnnotations, annotation(AnnotationPointer, "interface", reinterpret_cast<uintptr_t>(event.interface_tag)));
+					track_event.bytes(TrackEventAnnotations, annotation(AnnotationUint, "signal", event.index));
+					if (event.kind == McTraceEvent::Kind::CallBegin) {
+						track_event.bytes(TrackEventAnnotations, annotation(AnnotationPointer, "reciever", reinterpret_cast<uintptr_t>(event.reciever)));
+						track_event.bytes(TrackEventAnnotations, annotation(AnnotationPointer, "callable", reinterpret_cast<uintptr_t>(event.callable)));
+					}
+				}
+				__trace::ProtoWriter packet;
+				packet.varint(TracePacketTimestamp, event.timestamp_ns);
+				packet.varint(TracePacketSequenceId, thread.index);
+				packet.bytes(TracePacketTrackEvent, track_event.data());
+				writePacket(packet);
+			}
+		}
+	}
+
+	//The events recorded so far by McTracer
+	inline void McWriteChromeTrace(std::ostream& out) { McWriteChromeTrace(out, McTracer::collect()); }
+	inline void McWritePerfettoTrace(std::ostream& out) { McWritePerfettoTrace(out, McTracer::collect()); }
+};
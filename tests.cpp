@@ -1,6 +1,15 @@
 #include "multicall.h"
+#include "multicall_dispatcher.h"
+#include "multicall_coro.h"
+#include "multicall_shm.h"
+#include "multicall_record.h"
+#include "multicall_trace.h"
 #include "factory.h"
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <array>
 
 Factory global_factory;
 
@@ -29,10 +38,107 @@ public:
     }
 };
 
-std::atomic<int64_t> global_call_counter{ 0 };
-void global_tick_counter(int) {
-    ++global_call_counter;
-}
+class ManualSender : public SenderInterface, public MultiCallBase {
+public:
+    MC_DECLARE_SENDER()
+
+    void emitTick(int val) {
+        McEmit(McSignal<int>(this, &SenderInterface::tick), val);
+    }
+    void emitTick(int val, std::string text) {
+        McEmit(McSignal<int, std::string>(this, &SenderInterface::tick), val, text);
+    }
+    void emitTick2(int val) {
+        McEmit(McSignal(this, &SenderInterface::tick2), val);
+    }
+    void emitTickBatch(const std::vector<std::tuple<int>>& events) {
+        McEmitBatch(McSignal<int>(this, &SenderInterface::tick), events);
+    }
+    void emitTickParallel(McThreadPool& pool, McParallelMode mode, int val, size_t chunk_size = 0) {
+        McEmitParallel(pool, mode, chunk_size, McSignal<int>(this, &SenderInterface::tick), val);
+    }
+};
+
+class SelfDisconnector : public MultiCallBase {
+public:
+    SelfDisconnector(SenderInterface* sender) : sender_(sender) {}
+
+    int calls = 0;
+    void tick(int) {
+        ++calls;
+        MultiCallBase::Disconnect(McSignal<int>(sender_, &SenderInterface::tick), this, &SelfDisconnector::tick);
+    }
+
+private:
+    SenderInterface* sender_;
+};
+
+class QueuedReciever : public MultiCallBase {
+public:
+    std::vector<int> values;
+    void tick(int val) {
+        values.push_back(val);
+    }
+};
+
+class BatchReciever : public MultiCallBase {
+public:
+    std::vector<size_t> batch_sizes;
+    std::vector<int> values;
+    void ticks(McBatch<int> events) {
+        batch_sizes.push_back(events.size());
+        for (auto& [val] : events) {
+            values.push_back(val);
+        }
+    }
+};
+
+struct CopyCounter {
+    static inline int copies = 0;
+    int value = 0;
+    CopyCounter(int val) : value(val) {}
+    CopyCounter(const CopyCounter& other) : value(other.value) { ++copies; }
+    CopyCounter(CopyCounter&&) = default;
+    CopyCounter& operator = (const CopyCounter& other) { value = other.value; ++copies; return *this; }
+    CopyCounter& operator = (CopyCounter&&) = default;
+};
+
+class PayloadInterface {
+public:
+    MC_DECLARE_INTERFACE(PayloadInterface)
+
+    virtual ~PayloadInterface() = default;
+
+    MC_DECLARE_SIGNAL(payload(CopyCounter value))
+    MC_DECLARE_SIGNAL(owned(std::unique_ptr<int> value))
+};
+
+class PayloadSender : public PayloadInterface, public MultiCallBase {
+public:
+    MC_DECLARE_SENDER()
+
+    void emitPayload(CopyCounter value) {
+        McEmit(McSignal(this, &PayloadInterface::payload), std::move(value));
+    }
+    void emitOwned(std::unique_ptr<int> value) {
+        McEmit(McSignal(this, &PayloadInterface::owned), std::move(value));
+    }
+};
+
+class PayloadReciever : public MultiCallBase {
+public:
+    int sum = 0;
+    std::unique_ptr<int> owned;
+    void payload(const CopyCounter& value) {
+        sum += value.value;
+    }
+    void peek(const std::unique_ptr<int>& value) {
+        sum += *value;
+    }
+    void take(std::unique_ptr<int> value) {
+        owned = std::move(value);
+    }
+};
 
 std::atomic<int> global_counter{0};
 void global_ew_tick(int val) {
@@ -89,12 +195,12 @@ void Test_connect_disconnect_to_lambda() {
     Reciever reciever;
     for (int i = 0; i < 10; ++i) {
         int old_counter = reciever.counter;
-        auto [ok, id] = MultiCallBase::Connect(McSignal<int>(object1.get(), &SenderInterface::tick), [&reciever](int val) {
+        auto connection = MultiCallBase::Connect(McSignal<int>(object1.get(), &SenderInterface::tick), [&reciever](int val) {
             reciever.new_tick(val);
         });
 
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        MultiCallBase::Disconnect(McSignal<int>(object1.get(), &SenderInterface::tick), id);
+        MultiCallBase::Disconnect(McSignal<int>(object1.get(), &SenderInterface::tick), connection.id());
         assert(old_counter != reciever.counter);
         old_counter = reciever.counter;
         std::this_thread::sleep_for(std::chrono::milliseconds(50));
@@ -124,53 +230,1093 @@ void Test_two_senders() {
     std::this_thread::sleep_for(std::chrono::milliseconds(2000));
 }
 
-void Test_member_call_counter() {
-    auto object1 = global_factory.createSender(Factory::Type1);
+void Test_disconnect_inside_emit() {
+    ManualSender sender;
     Reciever reciever;
-    int64_t summ = 0;
-    static const int times = 5;
-    for (int i = 0; i < times; ++ i) {
-        MultiCallBase::Connect(McSignal<int>(object1.get(), &SenderInterface::tick), &reciever, &Reciever::tick_counter);
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        MultiCallBase::Disconnect(McSignal<int>(object1.get(), &SenderInterface::tick), &reciever, &Reciever::tick_counter);
-        summ += reciever.call_counter;
-        reciever.call_counter = 0;
+    SelfDisconnector disconnector(&sender);
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &disconnector, &SelfDisconnector::tick);
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+    sender.emitTick(1);
+    sender.emitTick(2);
+    assert(disconnector.calls == 1); //the running emit keeps its snapshot, the next one doesn't see the disconnected subscriber
+    assert(reciever.call_counter == 2);
+}
+
+void Test_disconnect_wait() {
+    ManualSender sender;
+    std::atomic<bool> in_call{ false };
+    std::atomic<int> calls{ 0 };
+    auto connection = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), [&in_call, &calls](int) {
+        in_call = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ++calls;
+        in_call = false;
+    });
+    std::atomic<bool> stop{ false };
+    std::thread emitter([&sender, &stop]() {
+        for (int i = 0; !stop; ++i) {
+            sender.emitTick(i);
+        }
+    });
+    while (calls < 5) {
+        std::this_thread::yield();
     }
-    std::cout << "calls member function per second = " << summ / times << std::endl;
+    connection.disconnect(McDisconnectMode::Wait);
+    assert(!in_call); //the running emit has finished
+    const int calls_after_disconnect = calls;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(calls == calls_after_disconnect);
+    stop = true;
+    emitter.join();
+
+    McFunctionId self_id;
+    int self_calls = 0;
+    auto self_connection = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), [&sender, &self_id, &self_calls](int) {
+        ++self_calls;
+        MultiCallBase::Disconnect(McSignal<int>(&sender, &SenderInterface::tick), self_id, McDisconnectMode::Wait); //doesn't wait for the emit calling it
+    });
+    self_id = self_connection.id();
+    sender.emitTick(1);
+    sender.emitTick(2);
+    assert(self_calls == 1);
+
+    //a subscriber disconnects another one that a second thread is running over the same snapshot
+    ManualSender shared_sender;
+    std::atomic<bool> in_slow{ false };
+    std::atomic<bool> waited_slow{ false };
+    McFunctionId slow_id;
+    const std::thread::id main_thread = std::this_thread::get_id();
+    MultiCallBase::Connect(McSignal<int>(&shared_sender, &SenderInterface::tick), [&](int) {
+        if (std::this_thread::get_id() == main_thread && !waited_slow) {
+            MultiCallBase::Disconnect(McSignal<int>(&shared_sender, &SenderInterface::tick), slow_id, McDisconnectMode::Wait);
+            waited_slow = !in_slow;
+        }
+    });
+    auto slow_connection = MultiCallBase::Connect(McSignal<int>(&shared_sender, &SenderInterface::tick), [&in_slow](int) {
+        in_slow = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        in_slow = false;
+    });
+    slow_id = slow_connection.id();
+    std::thread slow_emitter([&shared_sender]() { shared_sender.emitTick(1); });
+    while (!in_slow) {
+        std::this_thread::yield();
+    }
+    shared_sender.emitTick(2);
+    slow_emitter.join();
+    assert(waited_slow);
+
+    //an earlier async disconnect has replaced the snapshot another thread is running over: Wait still waits for that emit
+    ManualSender replaced_sender;
+    std::atomic<bool> in_blocker{ false };
+    std::atomic<bool> release_blocker{ false };
+    std::atomic<bool> b_called{ false };
+    auto blocker = MultiCallBase::Connect(McSignal<int>(&replaced_sender, &SenderInterface::tick), [&in_blocker, &release_blocker](int) {
+        in_blocker = true;
+        while (!release_blocker) {
+            std::this_thread::yield();
+        }
+    });
+    auto b = MultiCallBase::Connect(McSignal<int>(&replaced_sender, &SenderInterface::tick), [&b_called](int) { b_called = true; });
+    auto c = MultiCallBase::Connect(McSignal<int>(&replaced_sender, &SenderInterface::tick), [](int) {});
+    std::thread blocked_emitter([&replaced_sender]() { replaced_sender.emitTick(1); });
+    while (!in_blocker) {
+        std::this_thread::yield();
+    }
+    c.disconnect();
+    std::atomic<bool> b_returned{ false };
+    bool b_called_before_return = false;
+    std::thread b_disconnector([&]() {
+        b.disconnect(McDisconnectMode::Wait);
+        b_called_before_return = b_called;
+        b_returned = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(!b_returned); //the emit is still blocked in the first subscriber
+    release_blocker = true;
+    b_disconnector.join();
+    blocked_emitter.join();
+    assert(b_called_before_return);
+
+    //nested deeper than the recorded emits, disconnecting itself doesn't wait (and doesn't hang)
+    ManualSender deep_sender;
+    McFunctionId deep_id;
+    int deep_calls = 0;
+    auto deep_connection = MultiCallBase::Connect(McSignal<int>(&deep_sender, &SenderInterface::tick), [&deep_sender, &deep_id, &deep_calls](int depth) {
+        ++deep_calls;
+        if (depth < 40) {
+            deep_sender.emitTick(depth + 1);
+        }else {
+            MultiCallBase::Disconnect(McSignal<int>(&deep_sender, &SenderInterface::tick), deep_id, McDisconnectMode::Wait);
+        }
+    });
+    deep_id = deep_connection.id();
+    deep_sender.emitTick(1);
+    assert(deep_calls == 40);
+    deep_sender.emitTick(1);
+    assert(deep_calls == 40);
 }
 
-void Test_global_call_counter() {
-    auto object1 = global_factory.createSender(Factory::Type1);
-    int64_t summ = 0;
-    static const int times = 5;
-    for (int i = 0; i < times; ++i) {
-        MultiCallBase::Connect(McSignal<int>(object1.get(), &SenderInterface::tick), global_tick_counter);
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        MultiCallBase::Disconnect(McSignal<int>(object1.get(), &SenderInterface::tick), global_tick_counter);
-        summ += global_call_counter;
-        global_call_counter = 0;
+void Test_connection_handle() {
+    ManualSender sender;
+    Reciever reciever;
+    {
+        McScopedConnection scoped = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+        assert(scoped.connected());
+        sender.emitTick(1);
+        assert(reciever.call_counter == 1);
+    }
+    sender.emitTick(2); //the scoped handle has disconnected
+    assert(reciever.call_counter == 1);
+    assert(reciever.ConnectionGraph().sources.empty());
+
+    McConnection connection;
+    {
+        McScopedConnection scoped = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+        connection = scoped.release();
     }
-    std::cout << "calls global function per second = " << summ / times << std::endl;
+    McConnection duplicate = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+    assert(duplicate); //refers to the same connection
+    sender.emitTick(3);
+    assert(reciever.call_counter == 2);
+    McConnection moved = std::move(connection);
+    assert(!connection && moved);
+    assert(moved.disconnect());
+    assert(!moved.disconnect() && !duplicate.disconnect());
+    sender.emitTick(4);
+    assert(reciever.call_counter == 2);
+
+    //teardown of a reciever with many connections, the senders don't call it afterwards
+    std::vector<std::unique_ptr<ManualSender>> senders;
+    std::vector<McConnection> connections;
+    {
+        Reciever many;
+        for (int i = 0; i < 2000; ++i) {
+            senders.push_back(std::make_unique<ManualSender>());
+            connections.push_back(MultiCallBase::Connect(McSignal<int>(senders.back().get(), &SenderInterface::tick), &many, &Reciever::tick_counter));
+            MultiCallBase::Connect(McSignal<int>(senders.back().get(), &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+        }
+        assert(many.ConnectionGraph().sources.size() == 2000);
+    }
+    for (size_t i = 0; i < senders.size(); ++i) {
+        assert(!connections[i]);
+        senders[i]->emitTick(5);
+    }
+    assert(reciever.call_counter == 2002);
+    senders.clear(); //and the other way round
+    assert(reciever.ConnectionGraph().sources.empty());
 }
 
-void Test_lambda_call_counter() {
-    auto object1 = global_factory.createSender(Factory::Type1);
+void Test_many_subscribers() {
+    ManualSender sender;
+    static const int count = 300;
+    std::vector<int> calls;
+    std::vector<McConnection> connections;
+    for (int i = 0; i < count; ++i) {
+        auto connection = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), [&calls, i](int) {
+            calls.push_back(i);
+        });
+        assert(connection);
+        connections.push_back(std::move(connection));
+    }
+    Reciever reciever;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter); //duplicate is ignored
+    sender.emitTick(1);
+    assert(calls.size() == count);
+    for (int i = 0; i < count; ++i) {
+        assert(calls[i] == i); //subscribers are called in the order of connection
+    }
+    assert(reciever.call_counter == 1);
+
+    for (int i = 0; i < count; i += 2) {
+        assert(connections[i].disconnect());
+        assert(!connections[i]);
+    }
+    calls.clear();
+    sender.emitTick(2);
+    assert(calls.size() == count / 2);
+    for (int i = 0; i < count / 2; ++i) {
+        assert(calls[i] == i * 2 + 1);
+    }
+    assert(reciever.call_counter == 2);
+}
 
-    std::atomic<int64_t> counter;
+void Test_signal_slots() {
+    static_assert(decltype(std::declval<SenderInterface&>().tick(0))::index == 0);
+    static_assert(decltype(std::declval<SenderInterface&>().tick(0, std::string()))::index == 1);
+    static_assert(decltype(std::declval<SenderInterface&>().tick2(0))::index == 2);
+
+    ManualSender sender;
+    int tick_calls = 0, text_calls = 0, tick2_calls = 0;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), [&tick_calls](int) { ++tick_calls; });
+    MultiCallBase::Connect(McSignal<int, std::string>(&sender, &SenderInterface::tick), [&text_calls](int, std::string) { ++text_calls; });
+    MultiCallBase::Connect(McSignal(&sender, &SenderInterface::tick2), [&tick2_calls](int) { ++tick2_calls; });
+    sender.emitTick(1);
+    sender.emitTick(1, "text");
+    sender.emitTick(1, "text");
+    sender.emitTick2(1);
+    sender.emitTick2(1);
+    sender.emitTick2(1);
+    assert(tick_calls == 1 && text_calls == 2 && tick2_calls == 3);
+}
 
-    int64_t summ = 0;
-    static const int times = 5;
-    for (int i = 0; i < times; ++i) {
-        auto [ok, id] = MultiCallBase::Connect(McSignal<int>(object1.get(), &SenderInterface::tick), [&counter](int) {
-            ++counter;
+void Test_queued_connection() {
+    ManualSender sender;
+    {
+        QueuedReciever reciever;
+        MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &QueuedReciever::tick, McConnectionType::Queued);
+        sender.emitTick(1);
+        sender.emitTick(2);
+        assert(reciever.values.empty());
+        assert(reciever.ProcessEvents() == 2);
+        assert((reciever.values == std::vector<int>{ 1, 2 }));
+    }
+    {
+        QueuedReciever reciever;
+        reciever.SetupMailbox(4, McOverflowPolicy::DropNewest);
+        MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &QueuedReciever::tick, McConnectionType::Queued);
+        for (int i = 1; i <= 10; ++i) {
+            sender.emitTick(i);
+        }
+        reciever.ProcessEvents();
+        assert((reciever.values == std::vector<int>{ 1, 2, 3, 4 }));
+    }
+    {
+        QueuedReciever reciever;
+        reciever.SetupMailbox(4, McOverflowPolicy::DropOldest);
+        MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &QueuedReciever::tick, McConnectionType::Queued);
+        for (int i = 1; i <= 10; ++i) {
+            sender.emitTick(i);
+        }
+        reciever.ProcessEvents();
+        assert((reciever.values == std::vector<int>{ 7, 8, 9, 10 }));
+    }
+    {
+        QueuedReciever reciever;
+        reciever.SetupMailbox(16, McOverflowPolicy::Block);
+        MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &QueuedReciever::tick, McConnectionType::Queued);
+        static const int count = 100000;
+        std::thread emitter([&sender]() {
+            for (int i = 0; i < count; ++i) {
+                sender.emitTick(i);
+            }
         });
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        MultiCallBase::Disconnect(McSignal<int>(object1.get(), &SenderInterface::tick), id);
-        summ += counter;
-        counter = 0;
+        while (reciever.values.size() < count) {
+            reciever.ProcessEvents();
+        }
+        emitter.join();
+        for (int i = 0; i < count; ++i) {
+            assert(reciever.values[i] == i); //nothing is lost or reordered when the emitter is blocked
+        }
+    }
+    {
+        //the thread that processes the mailbox itself overflows it: Block can't wait for it, the overflow is dropped
+        QueuedReciever reciever;
+        MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &QueuedReciever::tick, McConnectionType::Queued);
+        for (int i = 0; i < 1025; ++i) {
+            sender.emitTick(i);
+        }
+        assert(reciever.ProcessEvents() == 1024);
+        assert(reciever.values.back() == 1023);
+    }
+    {
+        //an emitter blocked on a full mailbox gives up when the reciever is destroyed
+        auto reciever = std::make_unique<QueuedReciever>();
+        reciever->SetupMailbox(4, McOverflowPolicy::Block);
+        MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), reciever.get(), &QueuedReciever::tick, McConnectionType::Queued);
+        std::atomic<bool> filled{ false };
+        std::atomic<bool> returned{ false };
+        std::thread emitter([&]() {
+            for (int i = 0; i < 4; ++i) {
+                sender.emitTick(i);
+            }
+            filled = true;
+            sender.emitTick(4); //blocks
+            returned = true;
+        });
+        while (!filled) {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        assert(!returned);
+        reciever.reset();
+        emitter.join();
+        assert(returned);
+    }
+}
+
+void Test_emit_copies() {
+    PayloadSender sender;
+    std::vector<PayloadReciever> recievers(10);
+    for (PayloadReciever& reciever : recievers) {
+        MultiCallBase::Connect(McSignal(&sender, &PayloadInterface::payload), &reciever, &PayloadReciever::payload);
     }
+    CopyCounter::copies = 0;
+    sender.emitPayload(CopyCounter(7));
+    assert(CopyCounter::copies == 0); //every subscriber gets a reference to the same arguments
+    for (PayloadReciever& reciever : recievers) {
+        assert(reciever.sum == 7);
+    }
+
+    std::vector<PayloadReciever> queued(10);
+    for (PayloadReciever& reciever : queued) {
+        MultiCallBase::Connect(McSignal(&sender, &PayloadInterface::payload), &reciever, &PayloadReciever::payload, McConnectionType::Queued);
+    }
+    CopyCounter::copies = 0;
+    sender.emitPayload(CopyCounter(5));
+    for (PayloadReciever& reciever : queued) {
+        reciever.ProcessEvents();
+        assert(reciever.sum == 5);
+    }
+    assert(CopyCounter::copies <= 1); //the queued subscribers share one copy
+
+    PayloadReciever peeker, taker;
+    MultiCallBase::Connect(McSignal(&sender, &PayloadInterface::owned), &peeker, &PayloadReciever::peek);
+    MultiCallBase::Connect(McSignal(&sender, &PayloadInterface::owned), &taker, &PayloadReciever::take);
+    sender.emitOwned(std::make_unique<int>(3));
+    assert(peeker.sum == 3);
+    assert(taker.owned && *taker.owned == 3); //the last subscriber takes a move-only argument
+
+    //a move-only argument can't be shared by the subscribers that keep it: the queued connection is refused
+    static_assert(McCopyableArgs<CopyCounter>::value && !McCopyableArgs<std::unique_ptr<int>>::value);
+    PayloadReciever queued_peeker;
+    assert(!MultiCallBase::Connect(McSignal(&sender, &PayloadInterface::owned), &queued_peeker, &PayloadReciever::peek, McConnectionType::Queued));
+    //a subscriber taking it by value before the last one isn't skipped, the later ones get what is left of it
+    PayloadReciever early_taker;
+    MultiCallBase::Disconnect(McSignal(&sender, &PayloadInterface::owned), &peeker, &PayloadReciever::peek);
+    MultiCallBase::Disconnect(McSignal(&sender, &PayloadInterface::owned), &taker, &PayloadReciever::take);
+    MultiCallBase::Connect(McSignal(&sender, &PayloadInterface::owned), &early_taker, &PayloadReciever::take);
+    bool later_called = false;
+    MultiCallBase::Connect(McSignal(&sender, &PayloadInterface::owned), [&later_called](const std::unique_ptr<int>&) { later_called = true; });
+    sender.emitOwned(std::make_unique<int>(4));
+    assert(early_taker.owned && *early_taker.owned == 4 && later_called);
+    queued_peeker.ProcessEvents();
+}
+
+void Test_pool_allocator() {
+    void* block = McSlabPool::allocate(40);
+    McSlabPool::deallocate(block, 40);
+    McPoolStats before = McSlabPool::stats();
+    assert(McSlabPool::allocate(40) == block); //the thread reuses its freed blocks
+    assert(McSlabPool::stats().hits == before.hits + 1);
+    McSlabPool::deallocate(block, 40);
+
+    std::vector<void*> blocks;
+    for (int i = 0; i < 1000; ++i) {
+        blocks.push_back(McSlabPool::allocate(100));
+    }
+    std::thread([&blocks]() {
+        for (void* block : blocks) {
+            McSlabPool::deallocate(block, 100); //freed by another thread
+        }
+    }).join();
+
+    ManualSender sender;
+    Reciever reciever;
+    auto churn = [&]() {
+        for (int i = 0; i < 100; ++i) {
+            auto connection = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), [&reciever](int val) { reciever.counter = val; });
+            MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+            MultiCallBase::Disconnect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+            connection.disconnect();
+        }
+    };
+    churn();
+    before = McSlabPool::stats();
+    churn();
+    const McPoolStats after = McSlabPool::stats();
+    assert(after.hits > before.hits);
+    assert(after.misses == before.misses); //steady connect/disconnect doesn't go beyond the thread's free lists
+
+    //the counts of an exited thread stay, and a thread_local destructor running after the thread's flush still gets blocks
+    struct LateAllocation {
+        ~LateAllocation() {
+            void* late_block = McSlabPool::allocate(40);
+            McSlabPool::deallocate(late_block, 40);
+        }
+    };
+    before = McSlabPool::stats();
+    std::thread([]() {
+        static thread_local LateAllocation late; //constructed before the pool's flusher, so destroyed after it
+        (void)late;
+        McSlabPool::deallocate(McSlabPool::allocate(40), 40);
+        McSlabPool::deallocate(McSlabPool::allocate(40), 40);
+    }).join();
+    const McPoolStats exited = McSlabPool::stats();
+    assert(exited.hits >= before.hits + 1);
+    assert(exited.misses >= before.misses + 2); //the first allocation and the late one
+}
+
+void Test_inline_storage() {
+    ManualSender sender;
+    std::array<int64_t, 8> big_capture{ 1, 2, 3, 4, 5, 6, 7, 8 };
+    int64_t sum = 0;
+    auto big = [big_capture, &sum](int) { for (int64_t val : big_capture) { sum += val; } };
+    auto small = [&sum](int val) { sum += val; };
+    static_assert(!McFunctionIdImpl::fitsInlineFunction<decltype(big)>);
+    static_assert(McFunctionIdImpl::fitsInlineFunction<decltype(small)>);
+
+    auto big_connection = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), big);
+    assert(big_connection);
+    McFunctionId copy = big_connection.id(); //copies and moves of a heap callback keep it on the heap
+    McFunctionId moved = std::move(copy);
+    copy = moved;
+    assert(copy == big_connection.id() && moved == big_connection.id());
+    sender.emitTick(1);
+    assert(sum == 36);
+    MultiCallBase::Disconnect(McSignal<int>(&sender, &SenderInterface::tick), moved);
+    sender.emitTick(1);
+    assert(sum == 36);
+
+    auto inline_connection = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), McInline(small));
+    assert(inline_connection);
+    sender.emitTick(4);
+    assert(sum == 40);
+    inline_connection.disconnect();
+}
+
+void Test_function_id() {
+    Reciever reciever, other_reciever;
+    //Connect() keys a method by the signature of the signal, Disconnect() by its own parameters: the ids must still match
+    const McFunctionId by_signal(ArgsPlaceholder<int>{}, &reciever, &Reciever::tick_counter);
+    const McFunctionId by_method(&reciever, &Reciever::tick_counter);
+    assert(by_signal == by_method && by_signal.hash() == by_method.hash());
+    assert(by_signal.getObject() == static_cast<MultiCallBase*>(&reciever));
+    assert(!(by_signal == McFunctionId(&other_reciever, &Reciever::tick_counter)));
+
+    const McFunctionId function(&global_ew_tick);
+    assert(function.getObject() == nullptr && !(function == by_method));
+    assert(!(McFunctionId() == McFunctionId()) && McFunctionId().hash() == 0);
 
-    std::cout << "calls lambda per second = " << summ / times << std::endl;
+    //the key is kept by copies and moves, inline or on the heap
+    std::array<int64_t, 8> big_capture{};
+    const McFunctionId big(ArgsPlaceholder<int>{}, [big_capture](int) { (void)big_capture; });
+    McFunctionId copy = big;
+    McFunctionId moved = std::move(copy);
+    assert(moved == big && moved.hash() == big.hash());
+    McFunctionId member_copy = by_method;
+    member_copy = std::move(moved);
+    assert(member_copy == big && member_copy.getObject() == nullptr);
+
+    ManualSender sender;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+    assert(MultiCallBase::Disconnect(McSignal<int>(&sender, &SenderInterface::tick), by_method));
+    sender.emitTick(1);
+    assert(reciever.call_counter == 0);
+}
+
+void Test_idle_objects() {
+    auto allocations = []() { const McPoolStats stats = McSlabPool::stats(); return stats.hits + stats.misses + stats.oversized; };
+    const uint64_t before = allocations();
+    {
+        //objects that are never connected don't allocate their connection state, whatever is called on them
+        std::vector<ManualSender> senders(1000);
+        std::vector<Reciever> recievers(1000);
+        for (ManualSender& sender : senders) {
+            sender.emitTick(1);
+            assert(sender.ConnectionGraph().signals.empty() && sender.ProcessEvents() == 0);
+            MultiCallBase::Disconnect(McSignal<int>(&sender, &SenderInterface::tick), &recievers[0], &Reciever::tick_counter);
+        }
+        for (Reciever& reciever : recievers) {
+            reciever.DisconnectFromAll(McDisconnectMode::Wait);
+        }
+    }
+    assert(allocations() == before);
+
+    ManualSender sender;
+    Reciever reciever;
+    auto connection = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+    assert(allocations() > before);
+    sender.emitTick(1);
+    assert(reciever.call_counter == 1 && reciever.ConnectionGraph().sources.size() == 1);
+    connection.disconnect();
+    sender.emitTick(1); //the state stays after the last disconnection
+    assert(reciever.call_counter == 1 && reciever.ConnectionGraph().sources.empty());
+}
+
+void Test_tracing() {
+    ManualSender sender;
+    Reciever reciever;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+    int lambda_calls = 0;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), [&lambda_calls](int) { ++lambda_calls; });
+
+    McTracer::clear();
+    McTracer::enable();
+    McTracer::nameThread("main");
+    sender.emitTick(1);
+    McTracer::disable();
+    sender.emitTick(2);
+    std::vector<McTraceThread> threads = McTracer::collect();
+    assert(reciever.call_counter == 2 && lambda_calls == 2);
+#if MC_ENABLE_TRACING
+    using Kind = McTraceEvent::Kind;
+    assert(threads.size() == 1 && threads[0].name == "main" && threads[0].dropped == 0);
+    const std::vector<McTraceEvent>& events = threads[0].events;
+    assert(events.size() == 6);
+    assert(events[0].kind == Kind::EmitBegin && events[5].kind == Kind::EmitEnd);
+    assert(events[1].kind == Kind::CallBegin && events[2].kind == Kind::CallEnd && events[3].kind == Kind::CallBegin && events[4].kind == Kind::CallEnd);
+    assert(events[1].reciever == static_cast<MultiCallBase*>(&reciever) && events[3].reciever == nullptr && events[3].callable != nullptr);
+    for (size_t i = 0; i < events.size(); ++i) {
+        assert(events[i].sender == static_cast<MultiCallBase*>(&sender) && events[i].index == events[0].index);
+        assert(i == 0 || events[i].timestamp_ns >= events[i - 1].timestamp_ns);
+    }
+
+    std::ostringstream chrome;
+    McWriteChromeTrace(chrome, threads);
+    assert(chrome.str().find("\"ph\": \"B\"") != std::string::npos && chrome.str().find("\"main\"") != std::string::npos);
+    std::ostringstream perfetto;
+    McWritePerfettoTrace(perfetto, threads);
+    assert(!perfetto.str().empty() && perfetto.str()[0] == 0x0a); //Trace.packet
+
+    //a call that doesn't fit is dropped with its end, so the slices stay balanced
+    McTracer::clear();
+    McTracer::enable(5);
+    std::thread([&sender]() { sender.emitTick(3); }).join();
+    McTracer::disable();
+    threads = McTracer::collect();
+    assert(threads.size() == 1 && threads[0].events.size() == 4 && threads[0].dropped == 1);
+    assert(threads[0].events[3].kind == Kind::EmitEnd);
+
+    //clear() while an emit is running: the emit ends its slice in the forgotten buffer, the next call starts a new one
+    ManualSender clearing_sender;
+    MultiCallBase::Connect(McSignal<int>(&clearing_sender, &SenderInterface::tick), [](int) { McTracer::clear(); });
+    MultiCallBase::Connect(McSignal<int>(&clearing_sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+    McTracer::clear();
+    McTracer::enable();
+    clearing_sender.emitTick(4);
+    McTracer::disable();
+    threads = McTracer::collect();
+    assert(threads.size() == 1 && threads[0].events.size() == 2);
+    assert(threads[0].events[0].kind == Kind::CallBegin && threads[0].events[0].reciever == static_cast<MultiCallBase*>(&reciever));
+#else
+    assert(threads.empty() && !McTracer::enabled());
+#endif
+    McTracer::disable();
+    McTracer::clear();
+}
+
+void Test_connection_graph() {
+    ManualSender sender;
+    Reciever reciever1, reciever2;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever1, &Reciever::tick_counter);
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever2, &Reciever::tick_counter);
+    MultiCallBase::Connect(McSignal(&sender, &SenderInterface::tick2), [](int) {});
+    sender.emitTick(1);
+    sender.emitTick(2);
+
+    const McConnectionGraph graph = sender.ConnectionGraph();
+    assert(graph.object == &sender);
+    assert(graph.signals.size() == 2);
+    const McConnectionGraph::Signal& tick = graph.signals[0].subscribers.size() == 2 ? graph.signals[0] : graph.signals[1];
+    assert(tick.subscribers.size() == 2);
+    assert(tick.subscribers[0].reciever == &reciever1 && tick.subscribers[1].reciever == &reciever2);
+#if MC_ENABLE_METRICS
+    assert(tick.emits == 2);
+    assert(tick.subscribers[0].dispatch.calls == 2);
+#endif
+    assert(graph.sources.empty());
+
+    const McConnectionGraph reciever_graph = reciever1.ConnectionGraph();
+    assert(reciever_graph.signals.empty());
+    assert(reciever_graph.sources.size() == 1 && reciever_graph.sources[0].sender == &sender);
+    assert(!sender.DumpConnectionGraph().empty());
+}
+
+void Test_adaptive_mutex() {
+    //readers and writers that park all the time: a lost wakeup leaves a thread asleep and the watchdog fails the test
+    McAdaptiveSharedMutex mutex;
+    static const int threads_count = 4;
+    static const int iterations = 20000;
+    int64_t value = 0; //even outside of the writers
+    std::atomic<int> finished{ 0 };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threads_count; ++t) {
+        threads.emplace_back([&mutex, &value, &finished, t]() {
+            for (int i = 0; i < iterations; ++i) {
+                if ((i + t) % 4 == 0) {
+                    mutex.lock();
+                    ++value;
+                    std::this_thread::yield();
+                    ++value;
+                    mutex.unlock();
+                }else {
+                    mutex.lock_shared();
+                    assert(value % 2 == 0);
+                    std::this_thread::yield();
+                    mutex.unlock_shared();
+                }
+            }
+            ++finished;
+        });
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    while (finished < threads_count) {
+        assert(std::chrono::steady_clock::now() < deadline && "A waiter of McAdaptiveSharedMutex wasn't woken up");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    assert(value == threads_count * iterations / 4 * 2);
+}
+
+void Test_signal_locks() {
+    ManualSender sender;
+    Reciever reciever;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter);
+    std::atomic<bool> stop{ false };
+    std::thread emitter([&sender, &stop]() {
+        while (!stop) {
+            sender.emitTick(1);
+        }
+    });
+    //connections to the other signals of the sender and of the reciever itself while the sender emits
+    std::atomic<int> other_calls{ 0 };
+    ManualSender other_sender;
+    for (int i = 0; i < 1000; ++i) {
+        McScopedConnection tick2 = MultiCallBase::Connect(McSignal(&sender, &SenderInterface::tick2), [&other_calls](int) { ++other_calls; });
+        McScopedConnection text = MultiCallBase::Connect(McSignal<int, std::string>(&sender, &SenderInterface::tick), &reciever, &Reciever::new_tick);
+        McScopedConnection other = MultiCallBase::Connect(McSignal<int>(&other_sender, &SenderInterface::tick), &reciever, &Reciever::new_tick);
+        sender.emitTick2(i);
+    }
+    while (reciever.call_counter == 0) {
+        std::this_thread::yield(); //the emitter may not have been scheduled yet
+    }
+    stop = true;
+    emitter.join();
+    assert(other_calls == 1000);
+    assert(reciever.call_counter > 0);
+    assert(reciever.ConnectionGraph().sources.size() == 1);
+    assert(sender.ConnectionGraph().signals.size() == 1); //the signals without subscribers aren't listed
+}
+
+void Test_dispatcher() {
+#if defined(__linux__)
+    McDispatcher dispatcher;
+    assert(dispatcher.fd() >= 0);
+    ManualSender sender;
+    QueuedReciever reciever;
+    assert(dispatcher.bind(reciever));
+    assert(!dispatcher.bind(reciever)); //has a mailbox already
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &QueuedReciever::tick, McConnectionType::Queued);
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    assert(dispatcher.addTo(epoll_fd));
+    epoll_event event{};
+    assert(epoll_wait(epoll_fd, &event, 1, 0) == 0);
+
+    std::thread([&sender]() {
+        for (int i = 0; i < 100; ++i) {
+            sender.emitTick(i);
+        }
+    }).join();
+    assert(epoll_wait(epoll_fd, &event, 1, 1000) == 1 && event.data.ptr == &dispatcher);
+    uint64_t wakeups = 0;
+    assert(read(dispatcher.fd(), &wakeups, sizeof(wakeups)) == sizeof(wakeups));
+    assert(wakeups == 1); //one wakeup for the whole burst
+    assert(dispatcher.dispatch() == 100);
+    assert(reciever.values.size() == 100 && reciever.values[99] == 99);
+    assert(epoll_wait(epoll_fd, &event, 1, 0) == 0);
+
+    for (int i = 0; i < 10; ++i) {
+        sender.emitTick(i);
+    }
+    assert(dispatcher.dispatch(4) == 4);
+    assert(epoll_wait(epoll_fd, &event, 1, 0) == 1); //the rest is still pending
+    assert(dispatcher.dispatch() == 6);
+    assert(reciever.values.size() == 110);
+
+    {
+        QueuedReciever gone;
+        assert(dispatcher.bind(gone));
+        MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &gone, &QueuedReciever::tick, McConnectionType::Queued);
+        sender.emitTick(1);
+    }
+    dispatcher.dispatch(); //the event of the destroyed reciever is dropped
+    assert(reciever.values.size() == 111);
+    close(epoll_fd);
+#endif
+}
+
+void Test_shm_transport() {
+#if defined(__unix__)
+    const std::string name = "/multicall_test_" + std::to_string(getpid());
+    ManualSender sender;
+    McShmProxy<SenderInterface, int> early(name, &SenderInterface::tick); //before the producer
+    assert(!early.isOpen());
+    McShmPublisher<int> publisher(McSignal<int>(&sender, &SenderInterface::tick), name, 8);
+    assert(publisher.isOpen());
+    assert(early.open());
+
+    //the consumers map the ring on their own, as another process would
+    McShmProxy<SenderInterface, int> proxy(name, &SenderInterface::tick);
+    QueuedReciever reciever;
+    MultiCallBase::Connect(proxy.signal(), &reciever, &QueuedReciever::tick);
+    assert(proxy.poll() == 0);
+    for (int i = 0; i < 5; ++i) {
+        sender.emitTick(i);
+    }
+    assert(proxy.poll(2) == 2);
+    assert(proxy.poll() == 3);
+    assert((reciever.values == std::vector<int>{ 0, 1, 2, 3, 4 }));
+    assert(proxy.overruns() == 0);
+
+    //a slow consumer loses the oldest records and sees how many
+    reciever.values.clear();
+    for (int i = 0; i < 20; ++i) {
+        sender.emitTick(i);
+    }
+    assert(proxy.poll() == 8);
+    assert(proxy.overruns() == 12);
+    assert(reciever.values.front() == 12 && reciever.values.back() == 19);
+    assert(early.poll() == 8 && early.overruns() == 17);
+#endif
+}
+
+void Test_record_replay() {
+#if defined(__unix__)
+    const std::string path = "/tmp/multicall_test_" + std::to_string(getpid()) + ".mclog";
+    ManualSender sender;
+    {
+        McRecorder<int> recorder(McSignal<int>(&sender, &SenderInterface::tick), path, 4096); //several segments
+        assert(recorder.isOpen());
+        for (int i = 0; i < 1000; ++i) {
+            sender.emitTick(i);
+        }
+        recorder.close();
+        sender.emitTick(-1); //not recorded
+        assert(recorder.recorded() + recorder.dropped() == 1000);
+    }
+    McReplayer<SenderInterface, int> replayer(path, &SenderInterface::tick);
+    assert(replayer.isOpen());
+    QueuedReciever reciever;
+    MultiCallBase::Connect(replayer.signal(), &reciever, &QueuedReciever::tick);
+    const size_t replayed = replayer.replay(McReplayTiming::FullSpeed);
+    assert(replayed == reciever.values.size() && replayed > 0);
+    assert(std::is_sorted(reciever.values.begin(), reciever.values.end()) && reciever.values.back() <= 999);
+
+    //the original timing
+    {
+        McRecorder<int> recorder(McSignal<int>(&sender, &SenderInterface::tick), path);
+        sender.emitTick(1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        sender.emitTick(2);
+    }
+    McReplayer<SenderInterface, int> timed_replayer(path, &SenderInterface::tick);
+    std::vector<std::chrono::steady_clock::time_point> times;
+    MultiCallBase::Connect(timed_replayer.signal(), [&times](int) { times.push_back(std::chrono::steady_clock::now()); });
+    assert(timed_replayer.replay() == 2);
+    assert(times[1] - times[0] >= std::chrono::milliseconds(25));
+
+    McEventLogReader wrong_signature(path, McRecordCodec<int64_t>::signature, sizeof(int64_t));
+    assert(!wrong_signature.isOpen());
+
+    //several emitting threads: every record kept is in the file, in the order of the timestamps
+    {
+        McRecorder<int> recorder(McSignal<int>(&sender, &SenderInterface::tick), path, 4096);
+        std::vector<std::thread> emitters;
+        for (int t = 0; t < 4; ++t) {
+            emitters.emplace_back([&sender, t]() {
+                for (int i = 0; i < 2000; ++i) {
+                    sender.emitTick(t);
+                }
+            });
+        }
+        for (auto& emitter : emitters) {
+            emitter.join();
+        }
+        recorder.close();
+        assert(recorder.recorded() + recorder.dropped() == 8000);
+        McEventLogReader reader(path, McRecordCodec<int>::signature, sizeof(int));
+        uint64_t last_timestamp = 0;
+        const size_t read = reader.forEach([&last_timestamp](uint64_t timestamp, const uint8_t*) {
+            assert(timestamp >= last_timestamp);
+            last_timestamp = timestamp;
+            return true;
+        });
+        assert(read == recorder.recorded());
+    }
+
+    McEventLogWriter writer(path, McRecordCodec<int>::signature, sizeof(int), 4096);
+    assert(writer.isOpen());
+    assert(writer.append([](uint8_t* payload) { memset(payload, 0, sizeof(int)); }));
+    writer.close();
+    assert(!writer.isOpen());
+    assert(!writer.append([](uint8_t* payload) { memset(payload, 0, sizeof(int)); }) && writer.dropped() == 1);
+    unlink(path.c_str());
+#endif
+}
+
+#if defined(__cpp_impl_coroutine)
+//Fire-and-forget coroutine for the tests: starts at once and frees itself at the end
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+DetachedTask awaitTicks(ManualSender& sender, std::vector<int>& values) {
+    auto [first] = co_await McNext(McSignal<int>(&sender, &SenderInterface::tick));
+    values.push_back(first);
+    McSignalStream stream(McSignal<int>(&sender, &SenderInterface::tick));
+    for (int i = 0; i < 3; ++i) {
+        auto [value] = co_await stream.next();
+        values.push_back(value);
+    }
+}
+
+DetachedTask drainStream(McSignalStream<McInlineExecutor, int>& stream, std::vector<int>& values, int count) {
+    for (int i = 0; i < count; ++i) {
+        auto [value] = co_await stream.next();
+        values.push_back(value);
+    }
+}
+
+//Coroutine for the tests that is destroyed by its caller, while it is suspended
+struct OwnedTask {
+    struct promise_type {
+        OwnedTask get_return_object() noexcept { return OwnedTask{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+OwnedTask awaitTick(ManualSender& sender) {
+    co_await McNext(McSignal<int>(&sender, &SenderInterface::tick));
+}
+
+DetachedTask awaitOnPool(ManualSender& sender, McThreadPool& pool, std::atomic<int>& result) {
+    auto [value] = co_await McNext(McSignal<int>(&sender, &SenderInterface::tick), McPoolExecutor{ &pool });
+    result = value;
+}
+#endif
+
+void Test_coroutines() {
+#if defined(__cpp_impl_coroutine)
+    ManualSender sender;
+    std::vector<int> values;
+    awaitTicks(sender, values);
+    assert(values.empty());
+    for (int i = 1; i <= 5; ++i) {
+        sender.emitTick(i);
+    }
+    assert((values == std::vector<int>{ 1, 2, 3, 4 })); //the stream is connected after the first tick
+    assert(sender.ConnectionGraph().signals.empty());
+
+    //the ticks that come while nobody awaits are queued
+    values.clear();
+    McSignalStream stream(McSignal<int>(&sender, &SenderInterface::tick));
+    assert(stream.connected());
+    sender.emitTick(1);
+    sender.emitTick(2);
+    drainStream(stream, values, 3);
+    assert((values == std::vector<int>{ 1, 2 }));
+    sender.emitTick(3);
+    assert((values == std::vector<int>{ 1, 2, 3 }));
+
+    McThreadPool pool(2);
+    std::atomic<int> result{ 0 };
+    awaitOnPool(sender, pool, result);
+    sender.emitTick(7);
+    while (result == 0) {
+        std::this_thread::yield();
+    }
+    assert(result == 7);
+
+    //the awaiter is destroyed while another thread's emit, running over a snapshot an async disconnect has replaced, is about to call it
+    ManualSender blocked_sender;
+    std::atomic<bool> in_blocker{ false };
+    std::atomic<bool> release_blocker{ false };
+    std::atomic<bool> passed{ false };
+    MultiCallBase::Connect(McSignal<int>(&blocked_sender, &SenderInterface::tick), [&in_blocker, &release_blocker](int) {
+        in_blocker = true;
+        while (!release_blocker) {
+            std::this_thread::yield();
+        }
+    });
+    auto replaced = MultiCallBase::Connect(McSignal<int>(&blocked_sender, &SenderInterface::tick), [](int) {});
+    OwnedTask task = awaitTick(blocked_sender);
+    MultiCallBase::Connect(McSignal<int>(&blocked_sender, &SenderInterface::tick), [&passed](int) { passed = true; });
+    std::thread emitter([&blocked_sender]() { blocked_sender.emitTick(1); });
+    while (!in_blocker) {
+        std::this_thread::yield();
+    }
+    replaced.disconnect();
+    std::thread releaser([&release_blocker]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        release_blocker = true;
+    });
+    task.handle.destroy(); //waits for the emit, which neither resumes nor touches the destroyed awaiter
+    assert(passed);
+    releaser.join();
+    emitter.join();
+#endif
+}
+
+void Test_batch_emit() {
+    ManualSender sender;
+    QueuedReciever plain_reciever;
+    BatchReciever batch_reciever;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &plain_reciever, &QueuedReciever::tick);
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &batch_reciever, &BatchReciever::ticks);
+    sender.emitTickBatch({ { 1 }, { 2 }, { 3 } });
+    sender.emitTick(4);
+    assert((plain_reciever.values == std::vector<int>{ 1, 2, 3, 4 }));
+    assert((batch_reciever.values == std::vector<int>{ 1, 2, 3, 4 }));
+    assert((batch_reciever.batch_sizes == std::vector<size_t>{ 3, 1 }));
+
+    MultiCallBase::Disconnect(McSignal<int>(&sender, &SenderInterface::tick), &batch_reciever, &BatchReciever::ticks);
+    sender.emitTickBatch({ { 5 } });
+    assert(batch_reciever.values.size() == 4 && plain_reciever.values.size() == 5);
+}
+
+void Test_latest_value() {
+    ManualSender sender;
+    McLatest<int> latest;
+    McLatest<int>::Value value;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), latest);
+    assert(!latest.get(value) && !latest.take(value));
+    for (int i = 1; i <= 100; ++i) {
+        sender.emitTick(i);
+    }
+    assert(latest.take(value) && std::get<0>(value) == 100);
+    assert(!latest.take(value)); //nothing new
+    sender.emitTick(101);
+    assert(latest.get(value) && std::get<0>(value) == 101);
+    MultiCallBase::Disconnect(McSignal<int>(&sender, &SenderInterface::tick), latest.id());
+    sender.emitTick(102);
+    assert(latest.get(value) && std::get<0>(value) == 101);
+
+    QueuedReciever reciever;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &QueuedReciever::tick, McConnectionType::Latest);
+    for (int i = 1; i <= 100; ++i) {
+        sender.emitTick(i);
+    }
+    assert(reciever.ProcessEvents() == 1);
+    assert((reciever.values == std::vector<int>{ 100 }));
+    sender.emitTick(200);
+    reciever.ProcessEvents();
+    assert((reciever.values == std::vector<int>{ 100, 200 }));
+}
+
+void Test_throttled_connection() {
+    ManualSender sender;
+    Reciever reciever;
+    MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), &reciever, &Reciever::tick_counter, McConnectionType::Direct, McThrottle{ 5 });
+    for (int i = 0; i < 1000; ++i) {
+        sender.emitTick(i);
+    }
+    assert(reciever.call_counter == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    for (int i = 0; i < 1000; ++i) {
+        sender.emitTick(i);
+    }
+    assert(reciever.call_counter == 2);
+}
+
+void Test_keyed_connections() {
+    ManualSender sender;
+    McSignal<int> tick(&sender, &SenderInterface::tick);
+    QueuedReciever five, seven, all;
+    MultiCallBase::Connect(tick, &five, &QueuedReciever::tick, McKey(5));
+    McConnection seven_connection = MultiCallBase::Connect(tick, &seven, &QueuedReciever::tick, McKey(7));
+    MultiCallBase::Connect(tick, &all, &QueuedReciever::tick);
+    std::vector<int> big;
+    MultiCallBase::Connect(tick, [&big](int val) { big.push_back(val); }, McFilter([](int val) { return val >= 8; }));
+    for (int i = 0; i < 10; ++i) {
+        sender.emitTick(i);
+    }
+    assert((five.values == std::vector<int>{ 5 }));
+    assert((seven.values == std::vector<int>{ 7 }));
+    assert(all.values.size() == 10);
+    assert((big == std::vector<int>{ 8, 9 }));
+
+    //one callback for several keys, connecting the same key again changes nothing
+    McConnection six_connection = MultiCallBase::Connect(tick, &five, &QueuedReciever::tick, McKey(6));
+    assert(six_connection);
+    MultiCallBase::Connect(tick, &five, &QueuedReciever::tick, McKey(5));
+    sender.emitTick(5);
+    sender.emitTick(6);
+    assert((five.values == std::vector<int>{ 5, 5, 6 }));
+
+    seven_connection.disconnect();
+    sender.emitTick(7);
+    assert((seven.values == std::vector<int>{ 7 }));
+    six_connection.disconnect();
+    sender.emitTick(6);
+    assert((five.values == std::vector<int>{ 5, 5, 6 }));
+
+    //the keyed subscribers filter the batches themselves
+    sender.emitTickBatch({ { 5 }, { 6 }, { 5 } });
+    assert((five.values == std::vector<int>{ 5, 5, 6, 5, 5 }));
+
+    //a key extracted from the other arguments
+    std::vector<int> texts;
+    MultiCallBase::Connect(McSignal<int, std::string>(&sender, &SenderInterface::tick), [&texts](int val, const std::string&) { texts.push_back(val); },
+        McKey(std::string("b"), [](int, const std::string& text) { return text; }));
+    sender.emitTick(1, "a");
+    sender.emitTick(2, "b");
+    assert((texts == std::vector<int>{ 2 }));
+
+    //keys with the same salt (key hash ^ extractor) are still different connections
+    size_t (*plain_key)(int) = [](int val) { return size_t(val); };
+    size_t (*shifted_key)(int) = [](int val) { return size_t(val) + 1; };
+    const size_t colliding_key = size_t(5) ^ reinterpret_cast<size_t>(plain_key) ^ reinterpret_cast<size_t>(shifted_key);
+    int keyed_calls = 0;
+    auto count_call = [&keyed_calls](int) { ++keyed_calls; };
+    McConnection plain_connection = MultiCallBase::Connect(tick, count_call, McKey(size_t(5), plain_key));
+    McConnection colliding_connection = MultiCallBase::Connect(tick, count_call, McKey(colliding_key, shifted_key));
+    assert(plain_connection && colliding_connection);
+    assert(colliding_connection.disconnect());
+    sender.emitTick(5);
+    assert(keyed_calls == 1); //the first connection is still there
+    assert(plain_connection.disconnect());
+}
+
+void Test_parallel_emit() {
+    McThreadPool pool(4);
+    ManualSender sender;
+    static const int count = 1000;
+    std::atomic<int> calls{ 0 };
+    std::atomic<int64_t> summ{ 0 };
+    std::vector<McFunctionId> ids;
+    for (int i = 0; i < count; ++i) {
+        auto connection = MultiCallBase::Connect(McSignal<int>(&sender, &SenderInterface::tick), [&calls, &summ, i](int val) {
+            ++calls;
+            summ += val;
+        });
+        ids.push_back(connection.id());
+    }
+    sender.emitTickParallel(pool, McParallelMode::Wait, 2);
+    assert(calls == count && summ == count * 2);
+
+    sender.emitTickParallel(pool, McParallelMode::Detach, 1, 10);
+    while (calls < count * 2) {
+        std::this_thread::yield();
+    }
+    assert(summ == count * 3);
+
+    //disconnection while the chunks are running
+    for (int i = 0; i < 10; ++i) {
+        std::thread disconnector([&sender, &ids]() {
+            for (int j = 0; j < count; j += 2) {
+                MultiCallBase::Disconnect(McSignal<int>(&sender, &SenderInterface::tick), ids[j]);
+            }
+        });
+        sender.emitTickParallel(pool, McParallelMode::Wait, 1, 10);
+        disconnector.join();
+    }
+    calls = 0;
+    sender.emitTickParallel(pool, McParallelMode::Wait, 1);
+    assert(calls == count / 2);
 }
 
 int main() {
@@ -181,15 +1327,32 @@ int main() {
     Test_connect_disconnect_to_static_function();
     Test_connect_disconnect_to_lambda();
     Test_two_senders();
+    Test_disconnect_inside_emit();
+    Test_disconnect_wait();
+    Test_connection_handle();
+    Test_many_subscribers();
+    Test_signal_slots();
+    Test_queued_connection();
+    Test_emit_copies();
+    Test_pool_allocator();
+    Test_inline_storage();
+    Test_function_id();
+    Test_idle_objects();
+    Test_tracing();
+    Test_connection_graph();
+    Test_adaptive_mutex();
+    Test_signal_locks();
+    Test_dispatcher();
+    Test_shm_transport();
+    Test_record_replay();
+    Test_coroutines();
+    Test_batch_emit();
+    Test_latest_value();
+    Test_throttled_connection();
+    Test_keyed_connections();
+    Test_parallel_emit();
 
     std::cout << "all unit tests are successfully passed!" << std::endl;
-    std::cout << "start performance test" << std::endl;
-
-    Test_member_call_counter();
-    Test_global_call_counter();
-    Test_lambda_call_counter();
-
-    std::cout << "all tests are successfully passed!" << std::endl;
     
     system("pause");
 